@@ -0,0 +1,170 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+Arena::Block* Arena::Block::Create(size_t slot_size) {
+    void* memory = std::aligned_alloc(kBlockSize, kBlockSize);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    Block* block = new (memory) Block;
+    block->slot_size = slot_size;
+    block->capacity =
+        (kBlockSize - (block->Data() - static_cast<char*>(memory))) /
+        slot_size;
+    block->reciprocal = ((uint64_t(1) << 32) + slot_size - 1) / slot_size;
+    return block;
+}
+
+void Arena::Block::Release(void* slot) {
+    size_t index = Index(slot);
+    allocated[index / 64] &= ~(uint64_t(1) << (index % 64));
+    --live;
+
+    auto free_slot = static_cast<FreeSlot*>(slot);
+    free_slot->next = free_list;
+    free_list = free_slot;
+}
+
+Arena::SizeClass& Arena::ClassOf(Block* block) {
+    return classes_[block->slot_size / kGranularity - 1];
+}
+
+void* Arena::AllocateSlow(SizeClass& size_class, size_t slot_size) {
+    Block* block = nullptr;
+    while (!size_class.available.empty()) {
+        block = size_class.available.back();
+        size_class.available.pop_back();
+        block->listed = false;
+        if (block->live < block->capacity) {
+            break;
+        }
+        block = nullptr;
+    }
+
+    if (block == nullptr) {
+        block = Block::Create(slot_size);
+        block->position = size_class.blocks.size();
+        size_class.blocks.push_back(block);
+    }
+
+    size_class.current = block;
+    if (!block->has_young) {
+        block->has_young = true;
+        young_blocks_.push_back(block);
+    }
+    return block->Take();
+}
+
+void Arena::Free(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    block->Release(slot);
+
+    SizeClass& size_class = ClassOf(block);
+    if (block != size_class.current && !block->listed && !block->pending) {
+        block->listed = true;
+        size_class.available.push_back(block);
+    }
+}
+
+void Arena::BeginSweep() {
+    // Only old objects exist at this point, blocks on young_blocks_ just
+    // held the allocation cursor while marking.
+    for (Block* block : young_blocks_) {
+        block->has_young = false;
+    }
+    young_blocks_.clear();
+
+    pending_blocks_.clear();
+    for (auto& size_class : classes_) {
+        for (Block* block : size_class.blocks) {
+            block->listed = false;
+            block->pending = true;
+            pending_blocks_.push_back(block);
+        }
+        unreclaimed_blocks_ += size_class.blocks.size();
+        size_class.available.clear();
+        size_class.current = nullptr;
+    }
+}
+
+size_t Arena::ReclaimSwept() {
+    std::vector<Block*> swept;
+    {
+        std::lock_guard lock(swept_mutex_);
+        swept.swap(swept_blocks_);
+    }
+
+    size_t live = 0;
+    for (Block* block : swept) {
+        block->DropDeadOld();
+        block->pending = false;
+        live += block->live * block->slot_size;
+        Recycle(block);
+    }
+    unreclaimed_blocks_ -= swept.size();
+    return live;
+}
+
+size_t Arena::GetReservedBytes() const {
+    size_t blocks = 0;
+    for (const auto& size_class : classes_) {
+        blocks += size_class.blocks.size();
+    }
+    return blocks * kBlockSize;
+}
+
+void Arena::Recycle(Block* block) {
+    SizeClass& size_class = ClassOf(block);
+    if (block == size_class.current) {
+        return;
+    }
+
+    if (block->live == 0) {
+        if (block->listed) {
+            auto& available = size_class.available;
+            available.erase(std::find(available.begin(), available.end(), block));
+        }
+        Block* last = size_class.blocks.back();
+        last->position = block->position;
+        size_class.blocks[block->position] = last;
+        size_class.blocks.pop_back();
+        std::free(block);
+    } else if (!block->listed && block->live < block->capacity) {
+        block->listed = true;
+        size_class.available.push_back(block);
+    }
+}
+
+void Arena::Trim(SizeClass& size_class) {
+    size_t kept = 0;
+    for (Block* block : size_class.blocks) {
+        if (block->live == 0) {
+            std::free(block);
+        } else {
+            block->position = kept;
+            size_class.blocks[kept++] = block;
+        }
+    }
+    size_class.blocks.resize(kept);
+
+    size_class.available.clear();
+    size_class.current = nullptr;
+    for (Block* block : size_class.blocks) {
+        block->listed = block->live < block->capacity;
+        if (block->listed) {
+            size_class.available.push_back(block);
+        }
+    }
+}
+
+Arena::~Arena() {
+    for (auto& size_class : classes_) {
+        for (Block* block : size_class.blocks) {
+            std::free(block);
+        }
+    }
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Segregated size-class allocator. Memory is carved into kBlockSize-aligned
+// blocks, each serving slots of a single size, so the block owning a slot is
+// found by masking the slot address.
+//
+// Slots are young when allocated and become old once they survive a sweep.
+// Per-slot state (allocated, marked, old, remembered) lives in bitmaps in the
+// block header. Blocks waiting for a background sweep are never handed out
+// by the allocator.
+class Arena {
+public:
+    static constexpr size_t kBlockSize = 1 << 16;
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxSlotSize = 256;
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+public:
+    void* Allocate(size_t size);
+    void Free(void* slot);
+
+    // Sets the mark bit of a slot, returns false if it was already set.
+    static bool Mark(void* slot);
+    static bool IsOld(void* slot);
+
+    // Marks a slot and makes it old, so the running cycle keeps it.
+    static void Blacken(void* slot);
+
+    // Sets the remembered bit of a slot, returns false if it was already set.
+    static bool Remember(void* slot);
+    static void Forget(void* slot);
+
+    // Passes every allocated but unmarked slot to destroy and frees it. All
+    // survivors become old, mark and remembered bits are cleared, and blocks
+    // left empty are returned to the system. Returns the surviving bytes.
+    template <class F>
+    size_t Sweep(F&& destroy);
+
+    // Same as Sweep, but only looks at young slots. Old slots are kept
+    // whether marked or not. Returns the bytes promoted to the old space.
+    template <class F>
+    size_t SweepYoung(F&& destroy);
+
+    // Background form of Sweep. BeginSweep queues every block, SweepPending
+    // sweeps them and may run on another thread while the owner keeps
+    // allocating, and ReclaimSwept hands the blocks swept so far back to the
+    // allocator, returning their live bytes. The sweep is over once
+    // IsSweepDone is true.
+    void BeginSweep();
+    template <class F>
+    void SweepPending(F&& destroy);
+    size_t ReclaimSwept();
+    bool IsSweepDone() const;
+
+    // Neither may run while a background sweep is in progress.
+    size_t GetReservedBytes() const;
+    // Calls visit(slot, slot_size) for every allocated slot.
+    template <class F>
+    void ForEachSlot(F&& visit) const;
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Block {
+        static constexpr size_t kMaxSlots = kBlockSize / kGranularity;
+        static constexpr size_t kWords = kMaxSlots / 64;
+
+        size_t slot_size;
+        size_t capacity;
+        size_t position;
+        size_t bump = 0;
+        size_t live = 0;
+        uint32_t reciprocal;
+        bool listed = false;
+        bool has_young = false;
+        bool pending = false;
+        FreeSlot* free_list = nullptr;
+        uint64_t allocated[kWords] = {};
+        uint64_t marks[kWords] = {};
+        uint64_t old[kWords] = {};
+        uint64_t remembered[kWords] = {};
+
+        static Block* Create(size_t slot_size);
+        static Block* FromSlot(void* slot);
+
+        char* Data();
+        size_t Index(void* slot);
+        void* Take();
+        void Release(void* slot);
+
+        template <class F>
+        void SweepWord(size_t word, uint64_t dead, F& destroy);
+        // Frees unmarked slots and clears the marks. The old and remembered
+        // bits are left alone, since the barrier reads them concurrently.
+        template <class F>
+        size_t Sweep(F& destroy);
+        void DropDeadOld();
+    };
+
+    struct SizeClass {
+        std::vector<Block*> blocks;
+        std::vector<Block*> available;
+        Block* current = nullptr;
+    };
+
+private:
+    SizeClass& ClassOf(Block* block);
+    void* AllocateSlow(SizeClass& size_class, size_t slot_size);
+    void Trim(SizeClass& size_class);
+    void Recycle(Block* block);
+
+private:
+    std::array<SizeClass, kMaxSlotSize / kGranularity> classes_;
+    std::vector<Block*> young_blocks_;
+    std::vector<Block*> pending_blocks_;
+    size_t unreclaimed_blocks_ = 0;
+
+    std::mutex swept_mutex_;
+    std::vector<Block*> swept_blocks_;
+};
+
+inline char* Arena::Block::Data() {
+    constexpr size_t kHeader =
+        (sizeof(Block) + kGranularity - 1) / kGranularity * kGranularity;
+    return reinterpret_cast<char*>(this) + kHeader;
+}
+
+inline size_t Arena::Block::Index(void* slot) {
+    // Offsets stay below kBlockSize, so the fixed-point reciprocal is exact.
+    uint64_t offset = static_cast<char*>(slot) - Data();
+    return (offset * reciprocal) >> 32;
+}
+
+inline Arena::Block* Arena::Block::FromSlot(void* slot) {
+    return reinterpret_cast<Block*>(reinterpret_cast<uintptr_t>(slot) &
+                                    ~(kBlockSize - 1));
+}
+
+inline void* Arena::Block::Take() {
+    void* slot;
+    if (free_list != nullptr) {
+        slot = free_list;
+        free_list = free_list->next;
+    } else if (bump < capacity) {
+        slot = Data() + bump++ * slot_size;
+    } else {
+        return nullptr;
+    }
+
+    size_t index = Index(slot);
+    allocated[index / 64] |= uint64_t(1) << (index % 64);
+    ++live;
+    return slot;
+}
+
+template <class F>
+void Arena::Block::SweepWord(size_t word, uint64_t dead, F& destroy) {
+    while (dead != 0) {
+        size_t index = word * 64 + __builtin_ctzll(dead);
+        dead &= dead - 1;
+
+        void* slot = Data() + index * slot_size;
+        destroy(slot);
+        Release(slot);
+    }
+}
+
+template <class F>
+size_t Arena::Block::Sweep(F& destroy) {
+    for (size_t word = 0; word < kWords; ++word) {
+        uint64_t dead = allocated[word] & ~marks[word];
+        marks[word] = 0;
+        SweepWord(word, dead, destroy);
+    }
+    return live * slot_size;
+}
+
+inline void Arena::Block::DropDeadOld() {
+    for (size_t word = 0; word < kWords; ++word) {
+        old[word] &= allocated[word];
+    }
+}
+
+inline void* Arena::Allocate(size_t size) {
+    SizeClass& size_class = classes_[(size - 1) / kGranularity];
+    if (size_class.current != nullptr) {
+        if (void* slot = size_class.current->Take()) {
+            return slot;
+        }
+    }
+    return AllocateSlow(size_class, (size + kGranularity - 1) /
+                                        kGranularity * kGranularity);
+}
+
+inline bool Arena::Mark(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    size_t index = block->Index(slot);
+    uint64_t bit = uint64_t(1) << (index % 64);
+    uint64_t& word = block->marks[index / 64];
+    if (word & bit) {
+        return false;
+    }
+    word |= bit;
+    return true;
+}
+
+inline bool Arena::IsOld(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    size_t index = block->Index(slot);
+    return block->old[index / 64] & (uint64_t(1) << (index % 64));
+}
+
+inline void Arena::Blacken(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    size_t index = block->Index(slot);
+    uint64_t bit = uint64_t(1) << (index % 64);
+    block->marks[index / 64] |= bit;
+    block->old[index / 64] |= bit;
+}
+
+inline bool Arena::Remember(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    size_t index = block->Index(slot);
+    uint64_t bit = uint64_t(1) << (index % 64);
+    uint64_t& word = block->remembered[index / 64];
+    if (word & bit) {
+        return false;
+    }
+    word |= bit;
+    return true;
+}
+
+inline void Arena::Forget(void* slot) {
+    Block* block = Block::FromSlot(slot);
+    size_t index = block->Index(slot);
+    block->remembered[index / 64] &= ~(uint64_t(1) << (index % 64));
+}
+
+template <class F>
+size_t Arena::Sweep(F&& destroy) {
+    size_t live = 0;
+    for (auto& size_class : classes_) {
+        for (Block* block : size_class.blocks) {
+            live += block->Sweep(destroy);
+            for (size_t word = 0; word < Block::kWords; ++word) {
+                block->old[word] = block->allocated[word];
+                block->remembered[word] = 0;
+            }
+            block->has_young = false;
+            block->pending = false;
+        }
+        Trim(size_class);
+    }
+    young_blocks_.clear();
+    pending_blocks_.clear();
+    swept_blocks_.clear();
+    unreclaimed_blocks_ = 0;
+    return live;
+}
+
+template <class F>
+size_t Arena::SweepYoung(F&& destroy) {
+    // Every block allocated from since the last sweep is on young_blocks_,
+    // so the current blocks can be dropped and recycled along with them.
+    for (auto& size_class : classes_) {
+        size_class.current = nullptr;
+    }
+
+    size_t promoted = 0;
+    for (Block* block : young_blocks_) {
+        size_t survivors = 0;
+        for (size_t word = 0; word < Block::kWords; ++word) {
+            uint64_t young = block->allocated[word] & ~block->old[word];
+            uint64_t dead = young & ~block->marks[word];
+            block->marks[word] = 0;
+            block->SweepWord(word, dead, destroy);
+            block->old[word] = block->allocated[word];
+            survivors += __builtin_popcountll(young & ~dead);
+        }
+        block->has_young = false;
+        promoted += survivors * block->slot_size;
+        Recycle(block);
+    }
+    young_blocks_.clear();
+    return promoted;
+}
+
+inline bool Arena::IsSweepDone() const {
+    return unreclaimed_blocks_ == 0;
+}
+
+template <class F>
+void Arena::SweepPending(F&& destroy) {
+    for (Block* block : pending_blocks_) {
+        block->Sweep(destroy);
+        std::lock_guard lock(swept_mutex_);
+        swept_blocks_.push_back(block);
+    }
+}
+
+template <class F>
+void Arena::ForEachSlot(F&& visit) const {
+    for (const auto& size_class : classes_) {
+        for (Block* block : size_class.blocks) {
+            for (size_t word = 0; word < Block::kWords; ++word) {
+                uint64_t bits = block->allocated[word];
+                while (bits != 0) {
+                    size_t index = word * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    visit(block->Data() + index * block->slot_size,
+                          block->slot_size);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+// Checks that the call sites caching a builtin keep their cache while
+// lambdas bind names of builtins in their own frames, and that they still
+// see a builtin redefined in the global frame. Prints each failure and exits
+// with 1 if there was any.
+//
+//   cache_check
+
+#include <cstdio>
+#include <string>
+
+#include "lisp.h"
+#include "object.h"
+
+namespace {
+size_t errors = 0;
+
+void Expect(Interpreter* interpreter, const std::string& code,
+            const std::string& expected) {
+    std::string got;
+    try {
+        got = interpreter->Run(code);
+    } catch (std::exception& ex) {
+        got = ex.what();
+    }
+    if (got != expected) {
+        ++errors;
+        std::printf("%s: %s instead of %s\n", code.c_str(), got.c_str(),
+                    expected.c_str());
+    }
+}
+
+void ExpectVersion(const char* what, uint64_t before, bool changed) {
+    if ((Scope::GetBuiltinVersion() != before) != changed) {
+        ++errors;
+        std::printf("%s: builtin version %s\n", what,
+                    changed ? "kept" : "changed");
+    }
+}
+}  // namespace
+
+int main() {
+    Interpreter interpreter;
+    Expect(&interpreter, "(define pair (lambda (a b) (list a b)))", "#t");
+    Expect(&interpreter, "(define second (lambda (list) (max list 2)))", "#t");
+    Expect(&interpreter,
+           "(define loop (lambda (n) (second n) (pair n n)"
+           " (if (= n 0) 0 (loop (- n 1)))))",
+           "#t");
+    Expect(&interpreter, "(pair 1 2)", "(1 2)");
+
+    // Each call of second binds list in its frame. The list in pair is a
+    // global head, so its cache has to outlive those calls.
+    uint64_t version = Scope::GetBuiltinVersion();
+    Expect(&interpreter, "(loop 1000)", "0");
+    Expect(&interpreter, "(second 5)", "5");
+    Expect(&interpreter, "(pair 3 4)", "(3 4)");
+    ExpectVersion("parameter named list", version, false);
+
+    // A define in a lambda body only shadows the builtin in that frame.
+    Expect(&interpreter,
+           "(define minus (lambda (a b) (define + (lambda (x y) (- x y)))"
+           " (+ a b)))",
+           "#t");
+    Expect(&interpreter, "(minus 5 3)", "2");
+    Expect(&interpreter, "(+ 5 3)", "8");
+    ExpectVersion("define in a lambda body", version, false);
+
+    Expect(&interpreter, "(define list (lambda (a b) (+ a b)))", "#t");
+    ExpectVersion("global define of list", version, true);
+    Expect(&interpreter, "(pair 3 4)", "7");
+
+    if (errors != 0) {
+        std::printf("%zu failures\n", errors);
+        return 1;
+    }
+    std::printf("call site caches survive local bindings of builtin names\n");
+}
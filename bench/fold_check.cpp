@@ -0,0 +1,104 @@
+// Checks that calls made in the body of a loop fold: a call of a pure
+// builtin and a call of a global lambda, both with constant arguments. A
+// call to a lambda allocates a frame, so a loop whose call folded allocates
+// no more than the same loop with the value written out. Also checks that
+// the folds stop holding when the lambda or a builtin is redefined. Prints
+// each failure and exits with 1 if there was any.
+//
+//   fold_check
+
+#include <cstdio>
+#include <string>
+
+#include "heap.h"
+#include "lisp.h"
+
+namespace {
+constexpr int kIterations = 10000;
+
+size_t errors = 0;
+
+std::string Run(Interpreter* interpreter, const std::string& code) {
+    try {
+        return interpreter->Run(code);
+    } catch (std::exception& ex) {
+        return ex.what();
+    }
+}
+
+void Expect(Interpreter* interpreter, const std::string& code,
+            const std::string& expected) {
+    auto got = Run(interpreter, code);
+    if (got != expected) {
+        ++errors;
+        std::printf("%s: %s instead of %s\n", code.c_str(), got.c_str(),
+                    expected.c_str());
+    }
+}
+
+// Bytes allocated while code runs.
+size_t Allocated(Interpreter* interpreter, const std::string& code) {
+    size_t before = Heap::GetHeap().GetStats().allocated_bytes;
+    Run(interpreter, code);
+    return Heap::GetHeap().GetStats().allocated_bytes - before;
+}
+
+void Define(Interpreter* interpreter) {
+    Expect(interpreter, "(define (square x) (* x x))", "#t");
+    Expect(interpreter,
+           "(define plain (lambda (n acc)"
+           " (if (= n 0) acc (plain (- n 1) (+ acc 144)))))",
+           "#t");
+    Expect(interpreter,
+           "(define builtin (lambda (n acc)"
+           " (if (= n 0) acc (builtin (- n 1) (+ acc (* 12 12))))))",
+           "#t");
+    Expect(interpreter,
+           "(define call (lambda (n acc)"
+           " (if (= n 0) acc (call (- n 1) (+ acc (square 12))))))",
+           "#t");
+}
+}  // namespace
+
+int main() {
+    Interpreter interpreter;
+    Define(&interpreter);
+    std::string count = " " + std::to_string(kIterations) + " 0)";
+    std::string sum = std::to_string(144 * kIterations);
+    Expect(&interpreter, "(plain" + count, sum);
+    Expect(&interpreter, "(builtin" + count, sum);
+    Expect(&interpreter, "(call" + count, sum);
+
+    size_t plain = Allocated(&interpreter, "(plain" + count);
+    for (auto loop : {"builtin", "call"}) {
+        size_t bytes = Allocated(&interpreter, "(" + std::string(loop) + count);
+        if (bytes > plain) {
+            ++errors;
+            std::printf("%s: %zu bytes allocated instead of at most %zu\n",
+                        loop, bytes, plain);
+        }
+    }
+
+    // Without folding every call of square allocates a frame.
+    Interpreter unoptimized;
+    unoptimized.SetOptimization(false);
+    Define(&unoptimized);
+    size_t called = Allocated(&unoptimized, "(call" + count);
+    if (called < plain + kIterations * sizeof(Scope)) {
+        ++errors;
+        std::printf("call without folding: only %zu bytes allocated\n",
+                    called);
+    }
+
+    Expect(&interpreter, "(define (square x) (+ x x))", "#t");
+    Expect(&interpreter, "(call 10 0)", "240");
+    Expect(&interpreter, "(define * (lambda (a b) 1))", "#t");
+    Expect(&interpreter, "(builtin 10 0)", "10");
+    Expect(&interpreter, "(call 10 0)", "240");
+
+    if (errors != 0) {
+        std::printf("%zu failures\n", errors);
+        return 1;
+    }
+    std::printf("calls in loop bodies fold\n");
+}
@@ -0,0 +1,83 @@
+// Times full collections of a long list and of a deep chain of closure
+// frames. Both are as deep as they are long, so a marker that recursed into
+// children would run out of native stack here.
+//
+//   mark_bench [cells] [frames]
+//
+// The defaults are a 10M cell list and a 1M frame chain.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "heap.h"
+
+namespace {
+constexpr int kRuns = 5;
+
+double Milliseconds(Heap::Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// A list of cells holding the numbers from 0, linked through the tail the
+// way the parser links them.
+Object* BuildList(size_t size) {
+    auto& heap = Heap::GetHeap();
+    auto head = heap.Allocate<Cell>(heap.GetNumber(0));
+    auto last = As<Cell>(head);
+    for (size_t i = 1; i < size; ++i) {
+        auto cell = heap.Allocate<Cell>(heap.GetNumber(i));
+        last->SetSecond(cell);
+        last = As<Cell>(cell);
+    }
+    return head;
+}
+
+// Frames nested the way the frames of closures made inside one another are.
+Object* BuildFrames(size_t depth) {
+    auto& heap = Heap::GetHeap();
+    auto key = SymbolTable::GetTable().Intern("x");
+    Scope* scope = nullptr;
+    for (size_t i = 0; i < depth; ++i) {
+        scope = As<Scope>(heap.Allocate<Scope>(scope));
+        scope->AddForce(key, heap.GetNumber(i));
+    }
+    return scope;
+}
+
+void Measure(const char* name, Object* root) {
+    auto& heap = Heap::GetHeap();
+    heap.AddRoot(root);
+    // The first collection promotes the structure to the old generation.
+    heap.CollectAll();
+
+    double best_mark = 0;
+    double best_pause = 0;
+    for (int run = 0; run < kRuns; ++run) {
+        heap.CollectAll();
+        auto stats = heap.GetStats();
+        double mark = Milliseconds(stats.last_mark);
+        double pause = Milliseconds(stats.last_pause);
+        if (run == 0 || mark < best_mark) {
+            best_mark = mark;
+            best_pause = pause;
+        }
+    }
+    std::printf("%s: mark %.1f ms, full collection %.1f ms\n", name,
+                best_mark, best_pause);
+
+    heap.RemoveRoot(root);
+    heap.CollectAll();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t cells = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+    size_t frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "%zu cell list", cells);
+    Measure(name, BuildList(cells));
+    std::snprintf(name, sizeof(name), "%zu frame chain", frames);
+    Measure(name, BuildFrames(frames));
+}
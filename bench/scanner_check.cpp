@@ -0,0 +1,96 @@
+// Checks every scan implementation the CPU can run against kCharClasses, for
+// all 256 byte values in every class, and ParseDigits against a digit by
+// digit loop. Prints each mismatch and exits with 1 if there was any.
+//
+//   scanner_check
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "scanner.h"
+
+namespace {
+// Longer than one AVX2 block plus one SSE2 block, so each byte position is
+// seen in both vector loops and in the byte by byte tail.
+constexpr size_t kMaxSize = 80;
+
+struct Class {
+    const char* name;
+    uint8_t mask;
+    char member;
+    size_t (*RunScanners::*scan)(const char*, size_t, size_t);
+};
+
+constexpr Class kClasses[] = {
+    {"blank", kBlank, ' ', &RunScanners::blanks},
+    {"digit", kDigit, '0', &RunScanners::digits},
+    {"symbol", kSymbol, 'a', &RunScanners::symbol},
+};
+
+size_t errors = 0;
+
+// A run of members of the class with ch at one position, scanned from the
+// start, from ch and from half way to it. The scan has to stop at ch exactly
+// when the table says ch is outside the class.
+void CheckByte(const RunScanners& scanners, const Class& cls, int ch) {
+    auto scan = scanners.*cls.scan;
+    bool inside = kCharClasses[ch] & cls.mask;
+    for (size_t size = 1; size <= kMaxSize; ++size) {
+        std::string data(size, cls.member);
+        for (size_t at = 0; at < size; ++at) {
+            data[at] = static_cast<char>(ch);
+            for (size_t pos : {size_t{0}, at / 2, at}) {
+                size_t expected = inside ? size : at;
+                size_t got = scan(data.data(), pos, size);
+                if (got != expected && errors++ < 20) {
+                    std::printf("%s %s: byte 0x%02x at %zu of %zu from %zu: "
+                                "%zu instead of %zu\n",
+                                scanners.name, cls.name, ch, at, size, pos,
+                                got, expected);
+                }
+            }
+            data[at] = cls.member;
+        }
+    }
+}
+
+void CheckParseDigits() {
+    std::mt19937_64 random(42);
+    for (int run = 0; run < 100000; ++run) {
+        std::string digits(random() % 41, '0');
+        for (auto& ch : digits) {
+            ch = static_cast<char>('0' + random() % 10);
+        }
+
+        uint64_t expected = 0;
+        for (char ch : digits) {
+            expected = expected * 10 + (ch - '0');
+        }
+        uint64_t got = ParseDigits(digits.data(), digits.size());
+        if (got != expected && errors++ < 20) {
+            std::printf("ParseDigits(%s): %llu instead of %llu\n",
+                        digits.c_str(), static_cast<unsigned long long>(got),
+                        static_cast<unsigned long long>(expected));
+        }
+    }
+}
+}  // namespace
+
+int main() {
+    for (const auto& scanners : GetRunScanners()) {
+        for (const auto& cls : kClasses) {
+            for (int ch = 0; ch < 256; ++ch) {
+                CheckByte(scanners, cls, ch);
+            }
+        }
+        std::printf("%s: checked\n", scanners.name);
+    }
+    CheckParseDigits();
+
+    if (errors != 0) {
+        std::printf("%zu mismatches\n", errors);
+        return 1;
+    }
+    std::printf("all scanners agree with the class table\n");
+}
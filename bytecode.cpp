@@ -0,0 +1,446 @@
+#include "bytecode.h"
+#include "error.h"
+#include "heap.h"
+#include "object.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LISP_COMPUTED_GOTO
+#endif
+
+namespace {
+// Numbers and booleans evaluate to themselves. FakeNumber does not.
+bool IsSelfEvaluating(Object* obj) {
+    return Is<Boolean>(obj) || (Is<Number>(obj) && !Is<FakeNumber>(obj));
+}
+
+// The messages of kThrow, by count.
+enum Error : uint32_t { kNoFunction, kWrongFunction, kBadArguments };
+
+constexpr const char* kErrors[] = {
+    "No function provided",
+    "Wrong function provided",
+    "function eval error unknown",
+};
+}  // namespace
+
+// The call a unit runs in. ip is where the code goes on once the call below
+// it returns, arg_depth the number of calls in the frame still evaluating
+// their arguments.
+struct Code::Frame {
+    const Instruction* code;
+    const Instruction* ip;
+    Scope* scope;
+    uint32_t arg_depth;
+};
+
+// Shared by nested runs, each of which leaves them as it found them. Values
+// on them are not traced, collection only runs between top level forms.
+struct Code::Machine {
+    std::vector<Object*> stack;
+    std::vector<Frame> frames;
+};
+
+Code::Machine& Code::GetMachine() {
+    static Machine machine;
+    return machine;
+}
+
+Code::Code(Cell* cell) {
+    CompileCell(cell, true);
+    Emit(Op::kReturn);
+}
+
+Code::Code(LambdaCell* lambda) {
+    // The parameters come first, see LambdaInvoker::Bind.
+    const auto& body = lambda->GetBody();
+    size_t params = As<LambdaSymbol>(lambda->GetFirst())->GetVarc();
+    if (body.size() <= params) {
+        Emit(Op::kConst);
+        Emit(Op::kReturn);
+        return;
+    }
+    for (size_t i = params; i + 1 < body.size(); ++i) {
+        CompileValue(body[i], false);
+        Emit(Op::kPop);
+    }
+    CompileValue(body.back(), true);
+    Emit(Op::kReturn);
+}
+
+size_t Code::Emit(Op op, Object* operand, uint32_t count) {
+    code_.push_back({op, count, 0, 0, operand});
+    return code_.size() - 1;
+}
+
+void Code::Land(size_t jump) {
+    code_[jump].target = code_.size();
+}
+
+void Code::CompileValue(Object* obj, bool tail) {
+    if (Is<Cell>(obj)) {
+        CompileCell(As<Cell>(obj), tail);
+    } else if (IsSelfEvaluating(obj)) {
+        Emit(Op::kConst, obj);
+    } else {
+        Emit(Op::kEval, obj);
+    }
+}
+
+void Code::CompileCell(Cell* cell, bool tail) {
+    std::vector<size_t> exits;
+    auto site = cell->FindSite();
+    if (site != nullptr && site->folded != nullptr) {
+        size_t guard = Emit(Op::kFoldGuard, cell);
+        if (site->folded_branch) {
+            CompileValue(site->folded, tail);
+        } else {
+            Emit(Op::kConst, site->folded);
+        }
+        exits.push_back(Emit(Op::kJump));
+        Land(guard);
+    }
+
+    auto first = cell->GetFirst();
+    if (first == nullptr) {
+        Emit(Op::kThrow, nullptr, kNoFunction);
+    } else if (!Is<Symbol>(first) && !Is<LambdaInvoker>(first) && !Is<LambdaCell>(first)) {
+        Emit(Op::kThrow, nullptr, kWrongFunction);
+    } else {
+        // The head keeps its callee cache in the call site.
+        if (Is<CallCell>(cell)) {
+            As<CallCell>(cell)->GetSite();
+        }
+        Emit(Op::kHead, cell);
+        CompileIf(cell, tail, &exits);
+        CompileCall(cell, tail);
+    }
+
+    for (auto exit : exits) {
+        Land(exit);
+    }
+}
+
+void Code::CompileIf(Cell* cell, bool tail, std::vector<size_t>* exits) {
+    static const SymbolId kIf = SymbolTable::GetTable().Intern("if");
+    auto head = As<Symbol>(cell->GetFirst());
+    if (head == nullptr || head->GetId() != kIf) {
+        return;
+    }
+
+    // Anything If::SelectBranch would reject is left to it.
+    const auto& args = cell->GetArguments();
+    size_t argc = head->GetArgc();
+    if ((argc != 2 && argc != 3) || args.size() < argc) {
+        return;
+    }
+    Object* parts[3];
+    for (size_t i = 0; i < argc; ++i) {
+        parts[i] = Unevaluated(args[i]);
+        if (parts[i] == nullptr) {
+            return;
+        }
+    }
+
+    auto& heap = Heap::GetHeap();
+    size_t guard = Emit(Op::kIfGuard);
+    CompileValue(parts[0], false);
+    size_t skip = Emit(Op::kJumpIfFalse, heap.GetBoolean(false));
+    CompileValue(parts[1], tail);
+    exits->push_back(Emit(Op::kJump));
+    Land(skip);
+    if (argc == 3) {
+        CompileValue(parts[2], tail);
+    } else {
+        Emit(Op::kConst, heap.GetEmptyList());
+    }
+    exits->push_back(Emit(Op::kJump));
+    Land(guard);
+}
+
+void Code::CompileCall(Cell* cell, bool tail) {
+    // Lambdas know their own arity, builtins take it from the call site.
+    auto first = cell->GetFirst();
+    uint32_t argc;
+    if (Is<Symbol>(first)) {
+        argc = As<Symbol>(first)->GetArgc();
+    } else if (Is<LambdaCell>(first)) {
+        argc = As<LambdaSymbol>(As<LambdaCell>(first)->GetFirst())->GetVarc();
+    } else {
+        argc = As<LambdaInvoker>(first)->GetArgc();
+    }
+
+    size_t args_at = Emit(Op::kArgs, cell, argc);
+    // Lambdas may ask for more arguments than the call site has.
+    const auto& args = cell->GetArguments();
+    for (size_t i = 0; i < argc; ++i) {
+        if (i == args.size() || !CompileArgument(args[i])) {
+            Emit(Op::kThrow, nullptr, kBadArguments);
+            break;
+        }
+    }
+    Emit(tail ? Op::kTailCall : Op::kCall, nullptr, argc);
+    size_t done = Emit(Op::kJump);
+
+    code_[args_at].slow = code_.size();
+    Emit(Op::kCallSlow, cell, tail);
+    code_[args_at].target = code_.size();
+    Land(done);
+}
+
+bool Code::CompileArgument(Object* arg) {
+    auto left = Is<Cell>(arg) ? As<Cell>(arg)->GetFirst() : nullptr;
+    if (left == nullptr) {
+        return false;
+    }
+
+    if (Is<Symbol>(left) && As<Symbol>(left)->GetArgc() == 0) {
+        // A symbol without arguments is usually a plain variable. Only a
+        // function value needs the full call.
+        size_t variable = Emit(Op::kVariable, left);
+        CompileCell(As<Cell>(arg), false);
+        Land(variable);
+    } else if (Is<Symbol>(left)) {
+        CompileCell(As<Cell>(arg), false);
+    } else {
+        CompileValue(left, false);
+    }
+    return true;
+}
+
+Object* Code::Run(Scope* scope) const {
+    auto& machine = GetMachine();
+    size_t base = machine.frames.size();
+    size_t stack_base = machine.stack.size();
+    machine.frames.push_back({code_.data(), code_.data(), scope, 0});
+    try {
+        return Execute(base);
+    } catch (...) {
+        bool in_arguments = false;
+        for (size_t i = base; i < machine.frames.size(); ++i) {
+            in_arguments |= machine.frames[i].arg_depth != 0;
+        }
+        machine.frames.resize(base);
+        machine.stack.resize(stack_base);
+        if (in_arguments) {
+            throw RuntimeError(kErrors[kBadArguments]);
+        }
+        throw;
+    }
+}
+
+Object* Code::Execute(size_t base) {
+    auto& stack = GetMachine().stack;
+    auto& frames = GetMachine().frames;
+    const Instruction* code = frames.back().code;
+    const Instruction* ip = frames.back().ip;
+    Scope* scope = frames.back().scope;
+
+#ifdef LISP_COMPUTED_GOTO
+    static void* const kTargets[] = {
+        &&const_, &&eval,      &&fold_guard, &&throw_, &&head,
+        &&if_guard, &&jump_if_false, &&jump, &&variable, &&args,
+        &&call,   &&call,      &&call_slow,  &&pop,    &&return_,
+    };
+#define DISPATCH() goto* kTargets[static_cast<size_t>(ip->op)]
+#else
+#define DISPATCH()                 \
+    switch (ip->op) {              \
+        case Op::kConst:           \
+            goto const_;           \
+        case Op::kEval:            \
+            goto eval;             \
+        case Op::kFoldGuard:       \
+            goto fold_guard;       \
+        case Op::kThrow:           \
+            goto throw_;           \
+        case Op::kHead:            \
+            goto head;             \
+        case Op::kIfGuard:         \
+            goto if_guard;         \
+        case Op::kJumpIfFalse:     \
+            goto jump_if_false;    \
+        case Op::kJump:            \
+            goto jump;             \
+        case Op::kVariable:        \
+            goto variable;         \
+        case Op::kArgs:            \
+            goto args;             \
+        case Op::kCall:            \
+        case Op::kTailCall:        \
+            goto call;             \
+        case Op::kCallSlow:        \
+            goto call_slow;        \
+        case Op::kPop:             \
+            goto pop;              \
+        case Op::kReturn:          \
+            goto return_;          \
+    }
+#endif
+#define NEXT() \
+    ++ip;      \
+    DISPATCH()
+#define JUMP(to)         \
+    ip = code + (to);    \
+    DISPATCH()
+// Runs unit in frame_scope, in place of the current frame if replace is set.
+#define ENTER(unit, frame_scope, replace)                              \
+    if (replace) {                                                     \
+        frames.back() = {(unit).code_.data(), nullptr, frame_scope, 0}; \
+    } else {                                                           \
+        frames.back().ip = ip + 1;                                     \
+        frames.push_back({(unit).code_.data(), nullptr, frame_scope, 0}); \
+    }                                                                  \
+    code = ip = (unit).code_.data();                                   \
+    scope = frame_scope;                                               \
+    DISPATCH()
+
+    DISPATCH();
+
+const_:
+    stack.push_back(ip->operand);
+    NEXT();
+
+eval:
+    stack.push_back(EvalObject(ip->operand, scope));
+    NEXT();
+
+fold_guard: {
+    auto cell = static_cast<CallCell*>(ip->operand);
+    auto site = cell->site_.get();
+    if (site->folded_version != Scope::GetBuiltinVersion() ||
+        (site->folded_callee != nullptr && cell->EvalHead(scope) != site->folded_callee)) {
+        JUMP(ip->target);
+    }
+    NEXT();
+}
+
+throw_:
+    throw RuntimeError(kErrors[ip->count]);
+
+head:
+    stack.push_back(static_cast<Cell*>(ip->operand)->EvalHead(scope));
+    NEXT();
+
+if_guard:
+    if (!Is<If>(stack.back())) {
+        JUMP(ip->target);
+    }
+    stack.pop_back();
+    NEXT();
+
+jump_if_false: {
+    auto value = stack.back();
+    stack.pop_back();
+    if (value == ip->operand) {
+        JUMP(ip->target);
+    }
+    NEXT();
+}
+
+jump:
+    JUMP(ip->target);
+
+variable: {
+    auto value = ip->operand->Eval(scope);
+    if (!Is<Function>(value)) {
+        stack.push_back(value);
+        JUMP(ip->target);
+    }
+    NEXT();
+}
+
+args: {
+    auto callee = stack.back();
+    if (!Is<Function>(callee)) {
+        JUMP(ip->target);
+    }
+    // A lambda called with another arity than the call site's goes the
+    // way Cell::FinishCall handles it.
+    auto invoker = As<LambdaInvoker>(callee);
+    bool made_here = invoker != nullptr
+                         ? invoker->GetArgc() == static_cast<int>(ip->count)
+                         : As<Function>(callee)->GetArgumentKind() == ArgumentKind::kEval;
+    if (!made_here) {
+        JUMP(ip->slow);
+    }
+    ++frames.back().arg_depth;
+    NEXT();
+}
+
+call: {
+    size_t argc = ip->count;
+    size_t callee_at = stack.size() - argc - 1;
+    auto callee = stack[callee_at];
+    --frames.back().arg_depth;
+    if (auto invoker = As<LambdaInvoker>(callee)) {
+        Scope* frame_scope = invoker->Bind(&stack[callee_at + 1]);
+        stack.resize(callee_at);
+        ENTER(invoker->lambda_->GetCode(), frame_scope, ip->op == Op::kTailCall);
+    }
+
+    // The builtin may run code itself, which can move the stack.
+    auto func = As<Function>(callee);
+    Object* result;
+    if (argc == 1) {
+        auto arg = stack[callee_at + 1];
+        stack.resize(callee_at);
+        result = func->ApplyUnary(arg, scope);
+    } else if (argc == 2) {
+        auto lhs = stack[callee_at + 1];
+        auto rhs = stack[callee_at + 2];
+        stack.resize(callee_at);
+        result = func->ApplyBinary(lhs, rhs, scope);
+    } else {
+        // Copied one by one, a block copy of values just pushed stalls on
+        // the stores.
+        std::vector<Object*> call_args;
+        call_args.reserve(argc);
+        for (size_t i = callee_at + 1; i < stack.size(); ++i) {
+            call_args.push_back(stack[i]);
+        }
+        stack.resize(callee_at);
+        result = func->Apply(call_args, scope);
+    }
+    stack.push_back(result);
+    NEXT();
+}
+
+call_slow: {
+    auto callee = stack.back();
+    stack.pop_back();
+    TailCall tail;
+    Object* branch = nullptr;
+    auto cell = static_cast<Cell*>(ip->operand);
+    auto value = cell->FinishCall(callee, scope, &tail, &branch);
+    if (tail.invoker != nullptr) {
+        Scope* frame_scope = tail.invoker->Bind(tail.args.data());
+        ENTER(tail.invoker->lambda_->GetCode(), frame_scope, ip->count != 0);
+    } else if (branch != nullptr) {
+        ENTER(static_cast<CallCell*>(branch)->GetCode(), scope, ip->count != 0);
+    }
+    stack.push_back(value);
+    NEXT();
+}
+
+pop:
+    stack.pop_back();
+    NEXT();
+
+return_:
+    frames.pop_back();
+    if (frames.size() != base) {
+        code = frames.back().code;
+        ip = frames.back().ip;
+        scope = frames.back().scope;
+        DISPATCH();
+    }
+
+    auto value = stack.back();
+    stack.pop_back();
+    return value;
+
+#undef ENTER
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+}
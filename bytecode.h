@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Cell;
+class LambdaCell;
+class Object;
+class Scope;
+
+// How a function wants the arguments of a call.
+enum class ArgumentKind : uint8_t { kEval, kNoEval, kQuote };
+
+// Code compiled from the parse tree and run by a small VM. A unit is either
+// an expression, run by Cell::Eval, or the body of a lambda, run in the frame
+// of every call of its closures.
+//
+// Calls dispatch on the callee when they run. Lambdas and builtins that take
+// evaluated arguments are called by the VM, which keeps the frames of lambda
+// calls on a stack of its own and replaces the frame for a call in tail
+// position. An if is compiled to branches, guarded by a check that the head
+// still names the builtin. Every other call is finished by
+// Cell::FinishCall.
+class Code {
+public:
+    explicit Code(Cell* cell);
+    explicit Code(LambdaCell* lambda);
+
+    // Errors raised while the arguments of a call made by the VM are
+    // evaluated are rethrown as the RuntimeError of evaluated arguments.
+    Object* Run(Scope* scope) const;
+
+private:
+    enum class Op : uint8_t {
+        kConst,
+        kEval,
+        kFoldGuard,
+        kThrow,
+        kHead,
+        kIfGuard,
+        kJumpIfFalse,
+        kJump,
+        kVariable,
+        kArgs,
+        kCall,
+        kTailCall,
+        kCallSlow,
+        kPop,
+        kReturn,
+    };
+
+    // Jumps go to target. kArgs goes to slow for calls the VM does not
+    // make and to target for heads that are not functions.
+    struct Instruction {
+        Op op;
+        uint32_t count = 0;
+        uint32_t target = 0;
+        uint32_t slow = 0;
+        Object* operand = nullptr;
+    };
+
+    struct Frame;
+    struct Machine;
+
+private:
+    // Emits code that leaves the value of obj on the stack. In tail
+    // position a call to a lambda replaces the frame.
+    void CompileValue(Object* obj, bool tail);
+    void CompileCell(Cell* cell, bool tail);
+    void CompileIf(Cell* cell, bool tail, std::vector<size_t>* exits);
+    void CompileCall(Cell* cell, bool tail);
+    // Emits the code of one evaluated argument, or returns false if it can
+    // not be collected.
+    bool CompileArgument(Object* arg);
+
+    size_t Emit(Op op, Object* operand = nullptr, uint32_t count = 0);
+    // Points the jump at the next instruction emitted.
+    void Land(size_t jump);
+
+    static Machine& GetMachine();
+    static Object* Execute(size_t base);
+
+private:
+    std::vector<Instruction> code_;
+};
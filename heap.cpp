@@ -1,23 +1,311 @@
 #include "heap.h"
 
-void Heap::DeleteUnmarked() {
-    std::unordered_set<Object*> marked;
-    for (Object* obj : objects_) {
-        if (obj->marked_) {
-            marked.insert(obj);
-        } else {
-            delete obj;
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <typeindex>
+#include <unordered_map>
+
+namespace {
+void Destroy(void* slot) {
+    static_cast<Object*>(slot)->~Object();
+}
+
+// How many objects are marked between two looks at the clock.
+constexpr size_t kMarkBatch = 256;
+
+std::string TypeName(std::type_index type) {
+    const char* mangled = type.name();
+    int status;
+    char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    if (demangled == nullptr) {
+        return mangled;
+    }
+    std::string name = demangled;
+    std::free(demangled);
+    return name;
+}
+}  // namespace
+
+void Heap::AddRoot(Object* root) {
+    roots_.push_back(root);
+}
+
+void Heap::RemoveRoot(Object* root) {
+    roots_.erase(std::find(roots_.begin(), roots_.end(), root));
+}
+
+void Heap::AddConstant(Object* obj) {
+    constants_.push_back(obj);
+}
+
+void Heap::SetPauseTarget(std::chrono::microseconds pause) {
+    pause_target_ = pause;
+}
+
+void Heap::SetNurserySize(size_t bytes) {
+    nursery_size_ = bytes;
+}
+
+Heap::Stats Heap::GetStats() {
+    if (phase_ == Phase::kSweeping) {
+        FinishCycle();
+    }
+
+    Stats stats{};
+    stats.reserved_bytes = arena_.GetReservedBytes();
+    arena_.ForEachSlot([&stats](void*, size_t size) {
+        ++stats.live_objects;
+        stats.live_bytes += size;
+    });
+
+    stats.allocated_bytes = allocated_before_minor_ + allocated_since_minor_;
+    auto elapsed = std::chrono::duration<double>(Clock::now() - created_);
+    if (elapsed.count() > 0) {
+        stats.allocation_rate = stats.allocated_bytes / elapsed.count();
+    }
+
+    stats.minor_collections = minor_collections_;
+    stats.full_collections = full_collections_;
+    stats.pauses = pauses_;
+    stats.last_pause = last_pause_;
+    stats.max_pause = max_pause_;
+    stats.total_pause = total_pause_;
+    stats.last_minor_pause = last_minor_pause_;
+    stats.max_minor_pause = max_minor_pause_;
+    stats.total_minor_pause = total_minor_pause_;
+    stats.last_mark = last_mark_;
+    return stats;
+}
+
+std::vector<Heap::TypeStats> Heap::GetHistogram() {
+    if (phase_ == Phase::kSweeping) {
+        FinishCycle();
+    }
+
+    std::unordered_map<std::type_index, TypeStats> types;
+    // Every builtin is the one object of its class, so they share a row.
+    TypeStats builtins{"Builtin", 0, 0};
+    arena_.ForEachSlot([&types, &builtins](void* slot, size_t size) {
+        auto obj = static_cast<Object*>(slot);
+        auto& type = Is<Function>(obj) && !Is<LambdaInvoker>(obj)
+                         ? builtins
+                         : types[typeid(*obj)];
+        ++type.objects;
+        type.bytes += size;
+    });
+
+    std::vector<TypeStats> histogram;
+    for (auto& [index, type] : types) {
+        type.name = TypeName(index);
+        histogram.push_back(type);
+    }
+    if (builtins.objects != 0) {
+        histogram.push_back(builtins);
+    }
+    std::sort(histogram.begin(), histogram.end(),
+              [](const TypeStats& lhs, const TypeStats& rhs) {
+                  return lhs.bytes != rhs.bytes ? lhs.bytes > rhs.bytes
+                                                : lhs.name < rhs.name;
+              });
+    return histogram;
+}
+
+void Heap::RecordPause(Clock::time_point start) {
+    last_pause_ = Clock::now() - start;
+    max_pause_ = std::max(max_pause_, last_pause_);
+    total_pause_ += last_pause_;
+    ++pauses_;
+}
+
+void Heap::PushRoots() {
+    for (Object* root : roots_) {
+        Mark(root);
+    }
+    for (Object* constant : constants_) {
+        Mark(constant);
+    }
+}
+
+void Heap::MarkRoots() {
+    PushRoots();
+    DrainMarkStack();
+}
+
+bool Heap::DrainMarkStack(Clock::time_point deadline) {
+    size_t batch = 0;
+    while (!mark_stack_.empty()) {
+        if (++batch == kMarkBatch) {
+            batch = 0;
+            if (Clock::now() >= deadline) {
+                return false;
+            }
         }
+
+        Object* obj = mark_stack_.back();
+        mark_stack_.pop_back();
+        obj->MarkChildren(this);
+    }
+    return true;
+}
+
+void Heap::Collect() {
+    auto start = Clock::now();
+    if (phase_ != Phase::kIdle) {
+        Step(start + pause_target_);
+        RecordPause(start);
+        return;
     }
 
-    objects_ = std::move(marked);
-    Unmark();
+    if (allocated_since_minor_ < nursery_size_) {
+        return;
+    }
+
+    CollectYoung();
+    if (old_bytes_ > full_threshold_) {
+        StartCycle();
+    }
+    RecordPause(start);
+}
+
+void Heap::CollectYoung() {
+    auto start = Clock::now();
+    collecting_young_ = true;
+    MarkRoots();
+    for (Object* obj : remembered_) {
+        Arena::Forget(obj);
+        obj->MarkChildren(this);
+        DrainMarkStack();
+    }
+    collecting_young_ = false;
+
+    remembered_.clear();
+    old_bytes_ += arena_.SweepYoung(Destroy);
+    allocated_before_minor_ += allocated_since_minor_;
+    allocated_since_minor_ = 0;
+    ++minor_collections_;
+
+    last_minor_pause_ = Clock::now() - start;
+    max_minor_pause_ = std::max(max_minor_pause_, last_minor_pause_);
+    total_minor_pause_ += last_minor_pause_;
+}
+
+void Heap::CollectAll() {
+    auto start = Clock::now();
+    FinishCycle();
+    auto mark_start = Clock::now();
+    MarkRoots();
+    last_mark_ = Clock::now() - mark_start;
+
+    remembered_.clear();
+    old_bytes_ = arena_.Sweep(Destroy);
+    full_threshold_ = std::max(kMinFullThreshold, 2 * old_bytes_);
+    allocated_before_minor_ += allocated_since_minor_;
+    allocated_since_minor_ = 0;
+    ++full_collections_;
+    RecordPause(start);
+}
+
+void Heap::StartCycle() {
+    // The young generation was just emptied and everything allocated from
+    // now on is black, so the remembered set has nothing left to track.
+    for (Object* obj : remembered_) {
+        Arena::Forget(obj);
+    }
+    remembered_.clear();
+
+    phase_ = Phase::kMarking;
+    auto start = Clock::now();
+    PushRoots();
+    cycle_mark_ = Clock::now() - start;
+}
+
+void Heap::Step(Clock::time_point deadline) {
+    if (phase_ == Phase::kMarking) {
+        auto start = Clock::now();
+        bool done = DrainMarkStack(deadline);
+        cycle_mark_ += Clock::now() - start;
+        if (done) {
+            StartSweep();
+        }
+        return;
+    }
+
+    swept_bytes_ += arena_.ReclaimSwept();
+    if (arena_.IsSweepDone()) {
+        EndSweep();
+    }
 }
 
-void Heap::Unmark() {
-    for (auto obj : objects_) {
-        obj->Unmark();
+void Heap::FinishCycle() {
+    if (phase_ == Phase::kMarking) {
+        auto start = Clock::now();
+        DrainMarkStack();
+        cycle_mark_ += Clock::now() - start;
+        StartSweep();
     }
+    if (phase_ == Phase::kSweeping) {
+        WaitForSweeper();
+        swept_bytes_ += arena_.ReclaimSwept();
+        EndSweep();
+    }
+}
+
+void Heap::StartSweep() {
+    // The sweeper may still be leaving the previous cycle's block list.
+    WaitForSweeper();
+    phase_ = Phase::kSweeping;
+    last_mark_ = cycle_mark_;
+    swept_bytes_ = 0;
+    arena_.BeginSweep();
+
+    if (!sweeper_.joinable()) {
+        sweeper_ = std::thread(&Heap::RunSweeper, this);
+    }
+    {
+        std::lock_guard lock(sweeper_mutex_);
+        sweep_requested_ = true;
+    }
+    sweeper_cv_.notify_all();
+}
+
+void Heap::EndSweep() {
+    phase_ = Phase::kIdle;
+    ++full_collections_;
+    old_bytes_ = swept_bytes_;
+    full_threshold_ = std::max(kMinFullThreshold, 2 * old_bytes_);
+}
+
+void Heap::WaitForSweeper() {
+    std::unique_lock lock(sweeper_mutex_);
+    sweeper_cv_.wait(lock, [this] { return !sweep_requested_; });
+}
+
+void Heap::RunSweeper() {
+    std::unique_lock lock(sweeper_mutex_);
+    while (true) {
+        sweeper_cv_.wait(lock,
+                         [this] { return sweep_requested_ || stop_sweeper_; });
+        if (!sweep_requested_) {
+            return;
+        }
+
+        lock.unlock();
+        arena_.SweepPending(Destroy);
+        lock.lock();
+        sweep_requested_ = false;
+        sweeper_cv_.notify_all();
+    }
+}
+
+Heap::Heap() {
+    true_ = Allocate<Boolean>(true);
+    false_ = Allocate<Boolean>(false);
+    open_bracket_ = Allocate<Symbol>("(");
+    close_bracket_ = Allocate<Symbol>(")");
+    empty_list_ = Allocate<List>(std::vector{open_bracket_, close_bracket_});
+    constants_.insert(constants_.end(), {true_, false_, open_bracket_,
+                                         close_bracket_, empty_list_});
 }
 
 Heap& Heap::GetHeap() {
@@ -25,10 +313,15 @@ Heap& Heap::GetHeap() {
     return heap;
 }
 
-void Heap::Clear() {
-    objects_.clear();
-}
-
 Heap::~Heap() {
-    DeleteUnmarked();
+    FinishCycle();
+    if (sweeper_.joinable()) {
+        {
+            std::lock_guard lock(sweeper_mutex_);
+            stop_sweeper_ = true;
+        }
+        sweeper_cv_.notify_all();
+        sweeper_.join();
+    }
+    arena_.Sweep(Destroy);
 }
@@ -1,32 +1,226 @@
 #pragma once
 
-#include <unordered_set>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "arena.h"
 #include "lisp.h"
 #include "object.h"
 
+// Non-moving generational collector. Fresh objects are young; a minor
+// collection marks from the roots and the remembered set without entering
+// old objects, frees dead young objects and promotes the survivors in place.
+//
+// Old space is collected incrementally once it has doubled since the last
+// full cycle. The cycle marks in time-bounded slices with a
+// snapshot-at-the-beginning barrier, allocating black, and then hands the
+// blocks to a sweeper thread. Swept blocks are returned to the allocator by
+// later Collect calls. No minor collections run while a cycle is active.
+//
+// Minor collections are not sliced: their pause grows with the young data
+// that survives, so it is bounded by the nursery size and not by the pause
+// target. Their pauses are also counted on their own in Stats.
+//
+// Marking is iterative: Mark only flags an object and queues it on the mark
+// stack, and DrainMarkStack asks queued objects for their children.
 class Heap {
     friend class Interpreter;
 
 public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        size_t reserved_bytes;
+        size_t live_objects;
+        size_t live_bytes;
+        size_t allocated_bytes;
+        // Bytes allocated per second since the heap was created.
+        size_t allocation_rate;
+        size_t minor_collections;
+        size_t full_collections;
+        size_t pauses;
+        Clock::duration last_pause;
+        Clock::duration max_pause;
+        Clock::duration total_pause;
+        // Pauses of minor collections only, one per minor collection.
+        Clock::duration last_minor_pause;
+        Clock::duration max_minor_pause;
+        Clock::duration total_minor_pause;
+        // Time the last finished full collection spent marking, summed over
+        // its slices.
+        Clock::duration last_mark;
+    };
+
+    struct TypeStats {
+        std::string name;
+        size_t objects;
+        size_t bytes;
+    };
+
     static Heap& GetHeap();
 
 public:
-    Heap() = default;
+    Heap();
     ~Heap();
 
 public:
     template <class T, class... Args>
     requires std::is_convertible_v<T*, Object*> Object* Allocate(Args&&... args) {
-        Object* obj = new T(std::forward<Args>(args)...);
-        objects_.insert(obj);
+        static_assert(sizeof(T) <= Arena::kMaxSlotSize &&
+                      alignof(T) <= Arena::kGranularity);
+
+        void* memory = arena_.Allocate(sizeof(T));
+        Object* obj;
+        try {
+            obj = new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            arena_.Free(memory);
+            throw;
+        }
+
+        allocated_since_minor_ += sizeof(T);
+        if (phase_ == Phase::kMarking) {
+            Arena::Blacken(memory);
+        }
         return obj;
     }
 
+    // Only integers that do not fit in a fixnum are allocated, so computing
+    // with numbers almost never does.
+    Object* GetNumber(int64_t value) {
+        if (value >= kMinFixnum && value <= kMaxFixnum) {
+            return MakeFixnum(value);
+        }
+        return Allocate<Number>(value);
+    }
+
+    // Canonical constants, compared by identity. Every boolean and every
+    // list bracket marker is one of these objects.
+    Object* GetBoolean(bool value) {
+        return value ? true_ : false_;
+    }
+    Object* GetOpenBracket() {
+        return open_bracket_;
+    }
+    Object* GetCloseBracket() {
+        return close_bracket_;
+    }
+    Object* GetEmptyList() {
+        return empty_list_;
+    }
+
+    // Must be called whenever a field of holder that pointed to old_value is
+    // overwritten with value after holder was constructed.
+    void WriteBarrier(Object* holder, Object* old_value, Object* value) {
+        if (phase_ == Phase::kMarking) {
+            Mark(old_value);
+        } else if (value != nullptr && !IsFixnum(value) &&
+                   Arena::IsOld(holder) && !Arena::IsOld(value) &&
+                   Arena::Remember(holder)) {
+            remembered_.push_back(holder);
+        }
+    }
+
+    void Mark(Object* obj) {
+        if (obj != nullptr && !IsFixnum(obj) && TryMark(obj)) {
+            mark_stack_.push_back(obj);
+        }
+    }
+
+    void AddRoot(Object* root);
+    void RemoveRoot(Object* root);
+    // Keeps obj alive for as long as the heap exists.
+    void AddConstant(Object* obj);
+
+    // Longest time a single Collect call may spend on an incremental cycle.
+    // Minor collections always run to the end.
+    void SetPauseTarget(std::chrono::microseconds pause);
+    // Bytes allocated between two minor collections.
+    void SetNurserySize(size_t bytes);
+
+    // Collects both generations at once, finishing a running cycle first.
+    void CollectAll();
+
+    // Live counts include garbage not collected yet. Both calls finish a
+    // running background sweep first.
+    Stats GetStats();
+    // Allocated objects per type, largest total size first. Builtins are
+    // counted together as Builtin.
+    std::vector<TypeStats> GetHistogram();
+
 private:
-    void DeleteUnmarked();
-    void Unmark();
-    void Clear();
+    enum class Phase { kIdle, kMarking, kSweeping };
+
+    bool TryMark(Object* obj) {
+        if (collecting_young_ && Arena::IsOld(obj)) {
+            return false;
+        }
+        return Arena::Mark(obj);
+    }
+
+    void PushRoots();
+    void MarkRoots();
+    bool DrainMarkStack(Clock::time_point deadline = Clock::time_point::max());
+
+    void Collect();
+    void CollectYoung();
+
+    void StartCycle();
+    void Step(Clock::time_point deadline);
+    void FinishCycle();
+
+    void RecordPause(Clock::time_point start);
+
+    void StartSweep();
+    void EndSweep();
+    void WaitForSweeper();
+    void RunSweeper();
 
 private:
-    std::unordered_set<Object*> objects_;
+    static constexpr size_t kMinFullThreshold = 8 << 20;
+
+    Arena arena_;
+    std::vector<Object*> roots_;
+    // Shared objects that live as long as the heap.
+    std::vector<Object*> constants_;
+    Object* true_;
+    Object* false_;
+    Object* open_bracket_;
+    Object* close_bracket_;
+    Object* empty_list_;
+    std::vector<Object*> remembered_;
+    std::vector<Object*> mark_stack_;
+    bool collecting_young_ = false;
+
+    Phase phase_ = Phase::kIdle;
+    std::chrono::microseconds pause_target_{1000};
+    size_t nursery_size_ = 4 << 20;
+    size_t allocated_since_minor_ = 0;
+    size_t old_bytes_ = 0;
+    size_t swept_bytes_ = 0;
+    size_t full_threshold_ = kMinFullThreshold;
+
+    Clock::time_point created_ = Clock::now();
+    size_t allocated_before_minor_ = 0;
+    size_t minor_collections_ = 0;
+    size_t full_collections_ = 0;
+    size_t pauses_ = 0;
+    Clock::duration last_pause_{};
+    Clock::duration max_pause_{};
+    Clock::duration total_pause_{};
+    Clock::duration last_minor_pause_{};
+    Clock::duration max_minor_pause_{};
+    Clock::duration total_minor_pause_{};
+    Clock::duration last_mark_{};
+    Clock::duration cycle_mark_{};
+
+    std::thread sweeper_;
+    std::mutex sweeper_mutex_;
+    std::condition_variable sweeper_cv_;
+    bool sweep_requested_ = false;
+    bool stop_sweeper_ = false;
 };
@@ -1,18 +1,80 @@
 #include "lisp.h"
 #include "heap.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "resolver.h"
 #include "tokenizer.h"
 
 #include <cassert>
+#include <fstream>
+
+#if __has_include(<sys/mman.h>)
+#define LISP_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef LISP_HAS_MMAP
+// A read-only mapping of a whole regular file. Nothing is mapped if the
+// file is empty, not regular or can not be opened.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+            info.st_size > 0) {
+            void* data =
+                mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, info.st_size, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(data);
+                size_ = info.st_size;
+            }
+        }
+        // The mapping stays valid once the descriptor is closed.
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    bool IsMapped() const {
+        return data_ != nullptr;
+    }
+
+    std::string_view GetData() const {
+        return {data_, size_};
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+#endif
+}  // namespace
 
 Interpreter::Interpreter() {
     scope_ = As<Scope>(Heap::GetHeap().Allocate<Scope>());
+    Heap::GetHeap().AddRoot(scope_);
 }
 
 std::string Interpreter::Run(const std::string& str) {
     try {
-        std::istringstream in(str);
-        Tokenizer tokenizer(&in);
+        Tokenizer tokenizer(str);
 
         auto root = Read(&tokenizer);
 
@@ -20,12 +82,7 @@ std::string Interpreter::Run(const std::string& str) {
             throw SyntaxError("Bad operation");
         }
 
-        if (root == nullptr) {
-            throw RuntimeError("No operations");
-        }
-
-        auto result = root->Eval(scope_);
-        auto res = result->ToString();
+        auto res = Eval(root);
         ClearUnused();
         return res;
     } catch (...) {
@@ -34,11 +91,69 @@ std::string Interpreter::Run(const std::string& str) {
     }
 }
 
+void Interpreter::Run(
+    std::istream* in,
+    const std::function<void(const std::string&)>& on_result) {
+    Tokenizer tokenizer(in);
+    RunForms(&tokenizer, on_result);
+}
+
+void Interpreter::RunFile(
+    const std::string& path,
+    const std::function<void(const std::string&)>& on_result) {
+#ifdef LISP_HAS_MMAP
+    MappedFile file(path);
+    if (file.IsMapped()) {
+        Tokenizer tokenizer(file.GetData());
+        RunForms(&tokenizer, on_result);
+        return;
+    }
+#endif
+
+    std::ifstream in(path);
+    if (!in) {
+        throw RuntimeError("Can not open " + path);
+    }
+    Run(&in, on_result);
+}
+
+void Interpreter::RunForms(
+    Tokenizer* tokenizer,
+    const std::function<void(const std::string&)>& on_result) {
+    try {
+        while (!tokenizer->IsEnd()) {
+            auto res = Eval(Read(tokenizer));
+            ClearUnused();
+            on_result(res);
+        }
+    } catch (...) {
+        ClearUnused();
+        throw;
+    }
+}
+
+std::string Interpreter::Eval(Object* root) {
+    if (root == nullptr) {
+        throw RuntimeError("No operations");
+    }
+
+    Resolve(root);
+    if (optimize_) {
+        Optimize(root, scope_);
+    }
+
+    return ObjectToString(EvalObject(root, scope_));
+}
+
+void Interpreter::SetOptimization(bool enabled) {
+    optimize_ = enabled;
+}
+
 Interpreter::~Interpreter() {
-    Heap::GetHeap().DeleteUnmarked();
+    Heap::GetHeap().RemoveRoot(scope_);
+    Heap::GetHeap().CollectAll();
 }
 
 void Interpreter::ClearUnused() {
-    scope_->Mark();
-    Heap::GetHeap().DeleteUnmarked();
+    Heap::GetHeap().Collect();
 }
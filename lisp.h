@@ -1,19 +1,44 @@
 #pragma once
 
+#include <functional>
+#include <istream>
 #include <string>
 #include <memory>
 
 #include "object.h"
 
+class Tokenizer;
+
 class Interpreter {
 public:
     Interpreter();
     ~Interpreter();
     std::string Run(const std::string&);
 
+    // Runs the forms read from in one after another and passes the value
+    // of each to on_result. The stream is read a chunk at a time as the
+    // forms are parsed, and garbage is collected between forms. The first
+    // error stops the run.
+    void Run(std::istream* in,
+             const std::function<void(const std::string&)>& on_result);
+
+    // Same as running the file as a stream, but the tokenizer reads a
+    // read-only mapping of it where the system allows. Throws RuntimeError
+    // if the file can not be opened.
+    void RunFile(const std::string& path,
+                 const std::function<void(const std::string&)>& on_result);
+
+    // Whether expressions go through Optimize before they run, on by
+    // default. Turning it off can help when debugging the interpreter.
+    void SetOptimization(bool enabled);
+
 private:
+    void RunForms(Tokenizer* tokenizer,
+                  const std::function<void(const std::string&)>& on_result);
+    std::string Eval(Object* root);
     void ClearUnused();
 
 private:
     Scope* scope_;
+    bool optimize_ = true;
 };
@@ -2,12 +2,23 @@
 
 #include <iostream>
 
-int main() {
+int main(int argc, char** argv) {
     Interpreter interpreter;
 
-    while (true) {
-        std::string line;
-        std::getline(std::cin, line);
+    if (argc > 1) {
+        try {
+            interpreter.RunFile(argv[1], [](const std::string& result) {
+                std::cout << result << '\n';
+            });
+        } catch (std::exception& ex) {
+            std::cout << ex.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
         try {
             std::cout << interpreter.Run(line) << std::endl;
         } catch (std::exception& ex) {
@@ -9,18 +9,38 @@ bool IsArithmetic(const std::string& s) {
 }
 }  // namespace
 
-Number::Number(int64_t value) : value_(value) {
+Number::Number(int64_t value) : Number(ObjectType::kNumber, value) {
+}
+
+Number::Number(ObjectType type, int64_t value) : Object(type), value_(value) {
+}
+
+FakeNumber::FakeNumber(int64_t value) : Number(ObjectType::kFakeNumber, value) {
 }
 
 int64_t Number::GetValue() const {
     return value_;
 }
 
-Symbol::Symbol(const std::string& str) : name_(str) {
+Symbol::Symbol(const std::string& str) : Symbol(SymbolTable::GetTable().Intern(str)) {
+}
+
+Symbol::Symbol(SymbolId id) : Symbol(ObjectType::kSymbol, id) {
+}
+
+Symbol::Symbol(ObjectType type, SymbolId id) : Object(type), id_(id) {
+}
+
+LambdaSymbol::LambdaSymbol(const std::string& str)
+    : Symbol(ObjectType::kLambdaSymbol, SymbolTable::GetTable().Intern(str)) {
+}
+
+SymbolId Symbol::GetId() const {
+    return id_;
 }
 
 const std::string& Symbol::GetName() const {
-    return name_;
+    return SymbolTable::GetTable().GetName(id_);
 }
 
 void Symbol::AddArgc(int argc) {
@@ -35,10 +55,16 @@ bool Boolean::GetValue() const {
     return value_;
 }
 
-Boolean::Boolean(bool value) : value_(value) {
+Boolean::Boolean(bool value) : Object(ObjectType::kBoolean), value_(value) {
 }
 
-Cell::Cell(Object* first) : first_(first), second_(nullptr) {
+Cell::Cell(Object* first) : Cell(ObjectType::kCell, first) {
+}
+
+Cell::Cell(ObjectType type, Object* first) : Object(type), first_(first), second_(nullptr) {
+}
+
+CallCell::CallCell(Object* first) : Cell(ObjectType::kCallCell, first) {
 }
 
 Object* Cell::GetFirst() const {
@@ -49,117 +75,162 @@ Object* Cell::GetSecond() const {
 }
 
 void Cell::SetFirst(Object* ptr) {
+    Heap::GetHeap().WriteBarrier(this, first_, ptr);
     first_ = ptr;
 }
 void Cell::SetSecond(Object* ptr) {
+    Heap::GetHeap().WriteBarrier(this, second_, ptr);
     second_ = ptr;
 }
 
+const std::vector<Object*>& Cell::GetArguments() const {
+    static const std::vector<Object*> kNoArguments;
+    auto site = FindSite();
+    return site != nullptr ? site->args : kNoArguments;
+}
+
+CallSite* Cell::FindSite() const {
+    if (GetType() != ObjectType::kCallCell) {
+        return nullptr;
+    }
+    return static_cast<const CallCell*>(this)->site_.get();
+}
+
+CallSite* CallCell::GetSite() {
+    if (!site_) {
+        site_ = std::make_unique<CallSite>();
+    }
+    return site_.get();
+}
+
+void CallCell::SetArguments(std::vector<Object*> args) {
+    if (args.empty() && !site_) {
+        return;
+    }
+    GetSite()->args = std::move(args);
+}
+
+void CallCell::Fold(Object* value, bool branch, Object* callee) {
+    auto site = GetSite();
+    Heap::GetHeap().WriteBarrier(this, site->folded, value);
+    Heap::GetHeap().WriteBarrier(this, site->folded_callee, callee);
+    site->folded = value;
+    site->folded_version = Scope::GetBuiltinVersion();
+    site->folded_branch = branch;
+    site->folded_callee = callee;
+    site->code.reset();
+}
+
 Object* Number::Eval(Scope* scope) {
-    return Heap::GetHeap().Allocate<Number>(value_);
+    return this;
+}
+
+Object* FakeNumber::Eval(Scope* scope) {
+    return Heap::GetHeap().GetNumber(GetValue());
 }
 
 std::string Number::ToString() {
     return std::to_string(value_);
 }
 
+std::string ObjectToString(Object* obj) {
+    return IsFixnum(obj) ? std::to_string(GetInteger(obj)) : obj->ToString();
+}
+
+namespace {
+template <class T>
+void AddBuiltin(std::vector<Function*>* builtins, const std::string& name) {
+    auto function = Heap::GetHeap().Allocate<T>();
+    Heap::GetHeap().AddConstant(function);
+
+    SymbolId id = SymbolTable::GetTable().Intern(name);
+    if (id >= builtins->size()) {
+        builtins->resize(id + 1);
+    }
+    (*builtins)[id] = As<Function>(function);
+}
+
+// Indexed by symbol id, entries of other symbols are null.
+std::vector<Function*> MakeBuiltins() {
+    std::vector<Function*> builtins;
+    AddBuiltin<QuoteFunction>(&builtins, "quote");
+    AddBuiltin<IsNumber>(&builtins, "number?");
+    AddBuiltin<IsBoolean>(&builtins, "boolean?");
+    AddBuiltin<Equal>(&builtins, "=");
+    AddBuiltin<Less>(&builtins, "<");
+    AddBuiltin<Greater>(&builtins, ">");
+    AddBuiltin<LessEqual>(&builtins, "<=");
+    AddBuiltin<GreaterEqual>(&builtins, ">=");
+    AddBuiltin<Sum>(&builtins, "+");
+    AddBuiltin<Difference>(&builtins, "-");
+    AddBuiltin<Product>(&builtins, "*");
+    AddBuiltin<Division>(&builtins, "/");
+    AddBuiltin<Max>(&builtins, "max");
+    AddBuiltin<Min>(&builtins, "min");
+    AddBuiltin<Abs>(&builtins, "abs");
+    AddBuiltin<Not>(&builtins, "not");
+    AddBuiltin<And>(&builtins, "and");
+    AddBuiltin<Or>(&builtins, "or");
+    AddBuiltin<IsPair>(&builtins, "pair?");
+    AddBuiltin<IsNull>(&builtins, "null?");
+    AddBuiltin<IsList>(&builtins, "list?");
+    AddBuiltin<MakePair>(&builtins, "cons");
+    AddBuiltin<Head>(&builtins, "car");
+    AddBuiltin<Tail>(&builtins, "cdr");
+    AddBuiltin<MakeList>(&builtins, "list");
+    AddBuiltin<ListTail>(&builtins, "list-tail");
+    AddBuiltin<ListRef>(&builtins, "list-ref");
+    AddBuiltin<IsSymbol>(&builtins, "symbol?");
+    AddBuiltin<DefineVar>(&builtins, "_define-var");
+    AddBuiltin<SetVar>(&builtins, "_set-var");
+    AddBuiltin<SetHead>(&builtins, "set-car!");
+    AddBuiltin<SetTail>(&builtins, "set-cdr!");
+    AddBuiltin<If>(&builtins, "if");
+    AddBuiltin<GcStats>(&builtins, "gc-stats");
+    AddBuiltin<HeapHistogram>(&builtins, "heap-histogram");
+    return builtins;
+}
+}  // namespace
+
+Function* FindBuiltin(SymbolId id) {
+    static const auto kBuiltins = MakeBuiltins();
+    return id < kBuiltins.size() ? kBuiltins[id] : nullptr;
+}
+
+Object* Unevaluated(Object* arg) {
+    if (Is<LambdaCell>(arg)) {
+        return arg;
+    } else if (!Is<Cell>(arg)) {
+        return nullptr;
+    } else if (Is<Symbol>(As<Cell>(arg)->GetFirst())) {
+        return arg;
+    }
+    return As<Cell>(arg)->GetFirst();
+}
+
 Object* Symbol::Eval(Scope* scope) {
-    auto alias = scope->Get(name_);
+    auto alias = scope->Get(id_, &address_);
     if (alias != nullptr) {
         if (Is<Symbol>(alias) && IsArithmetic(As<Symbol>(alias)->GetName())) {
-            auto s = As<Symbol>(alias)->GetName();
-
-            if (s == "+") {
-                return Heap::GetHeap().Allocate<Sum>(argc_);
-            } else if (s == "-") {
-                return Heap::GetHeap().Allocate<Difference>(argc_);
-            } else if (s == "*") {
-                return Heap::GetHeap().Allocate<Product>(argc_);
-            } else if (s == "/") {
-                return Heap::GetHeap().Allocate<Division>(argc_);
-            }
+            return FindBuiltin(As<Symbol>(alias)->GetId());
         }
 
         return alias;
     }
 
-    if (name_ == "quote") {
-        return Heap::GetHeap().Allocate<QuoteFunction>(argc_);
-    } else if (name_ == "number?") {
-        return Heap::GetHeap().Allocate<IsNumber>(argc_);
-    } else if (name_ == "boolean?") {
-        return Heap::GetHeap().Allocate<IsBoolean>(argc_);
-    } else if (name_ == "=") {
-        return Heap::GetHeap().Allocate<Equal>(argc_);
-    } else if (name_ == "<") {
-        return Heap::GetHeap().Allocate<Less>(argc_);
-    } else if (name_ == ">") {
-        return Heap::GetHeap().Allocate<Greater>(argc_);
-    } else if (name_ == "<=") {
-        return Heap::GetHeap().Allocate<LessEqual>(argc_);
-    } else if (name_ == ">=") {
-        return Heap::GetHeap().Allocate<GreaterEqual>(argc_);
-    } else if (name_ == "+") {
-        return Heap::GetHeap().Allocate<Sum>(argc_);
-    } else if (name_ == "-") {
-        return Heap::GetHeap().Allocate<Difference>(argc_);
-    } else if (name_ == "*") {
-        return Heap::GetHeap().Allocate<Product>(argc_);
-    } else if (name_ == "/") {
-        return Heap::GetHeap().Allocate<Division>(argc_);
-    } else if (name_ == "max") {
-        return Heap::GetHeap().Allocate<Max>(argc_);
-    } else if (name_ == "min") {
-        return Heap::GetHeap().Allocate<Min>(argc_);
-    } else if (name_ == "abs") {
-        return Heap::GetHeap().Allocate<Abs>(argc_);
-    } else if (name_ == "not") {
-        return Heap::GetHeap().Allocate<Not>(argc_);
-    } else if (name_ == "and") {
-        return Heap::GetHeap().Allocate<And>(argc_);
-    } else if (name_ == "or") {
-        return Heap::GetHeap().Allocate<Or>(argc_);
-    } else if (name_ == "pair?") {
-        return Heap::GetHeap().Allocate<IsPair>(argc_);
-    } else if (name_ == "null?") {
-        return Heap::GetHeap().Allocate<IsNull>(argc_);
-    } else if (name_ == "list?") {
-        return Heap::GetHeap().Allocate<IsList>(argc_);
-    } else if (name_ == "cons") {
-        return Heap::GetHeap().Allocate<MakePair>(argc_);
-    } else if (name_ == "car") {
-        return Heap::GetHeap().Allocate<Head>(argc_);
-    } else if (name_ == "cdr") {
-        return Heap::GetHeap().Allocate<Tail>(argc_);
-    } else if (name_ == "list") {
-        return Heap::GetHeap().Allocate<MakeList>(argc_);
-    } else if (name_ == "list-tail") {
-        return Heap::GetHeap().Allocate<ListTail>(argc_);
-    } else if (name_ == "list-ref") {
-        return Heap::GetHeap().Allocate<ListRef>(argc_);
-    } else if (name_ == "symbol?") {
-        return Heap::GetHeap().Allocate<IsSymbol>(argc_);
-    } else if (name_ == "_define-var") {
-        return Heap::GetHeap().Allocate<DefineVar>(argc_);
-    } else if (name_ == "_set-var") {
-        return Heap::GetHeap().Allocate<SetVar>(argc_);
-    } else if (name_ == "set-car!") {
-        return Heap::GetHeap().Allocate<SetHead>(argc_);
-    } else if (name_ == "set-cdr!") {
-        return Heap::GetHeap().Allocate<SetTail>(argc_);
-    } else if (name_ == "if") {
-        return Heap::GetHeap().Allocate<If>(argc_);
-    }
-
-    throw NameError("no such name: " + name_);
+    if (auto builtin = FindBuiltin(id_)) {
+        return builtin;
+    }
+
+    throw NameError("no such name: " + GetName());
 }
 
 std::string Symbol::ToString() {
-    return name_;
+    return GetName();
 }
 
 Object* Boolean::Eval(Scope* scope) {
-    return Heap::GetHeap().Allocate<Boolean>(value_);
+    return this;
 }
 
 std::string Boolean::ToString() {
@@ -170,36 +241,98 @@ std::string Boolean::ToString() {
 }
 
 Object* Cell::Eval(Scope* scope) {
-    if (GetFirst() == nullptr) {
-        throw RuntimeError("No function provided");
-    }
+    return Code(this).Run(scope);
+}
 
-    if (!Is<Symbol>(GetFirst()) && !Is<LambdaInvoker>(GetFirst()) && !Is<LambdaCell>(GetFirst())) {
-        throw RuntimeError("Wrong function provided");
-    }
+Object* CallCell::Eval(Scope* scope) {
+    return GetCode().Run(scope);
+}
 
-    auto func = GetFirst()->Eval(scope);
+const Code& CallCell::GetCode() {
+    auto site = GetSite();
+    if (!site->code) {
+        site->code = std::make_unique<Code>(this);
+    }
+    return *site->code;
+}
 
-    if (Is<LambdaInvoker>(func) && Is<Symbol>(GetFirst())) {
-        if (As<LambdaInvoker>(func)->GetArgc() != As<Symbol>(GetFirst())->GetArgc()) {
-            auto args = As<LambdaInvoker>(func)->CollectArgs(GetSecond(), scope);
+Object* Cell::FinishCall(Object* func, Scope* scope, TailCall* tail, Object** branch) {
+    if (Is<LambdaInvoker>(func) && Is<Symbol>(first_)) {
+        if (As<LambdaInvoker>(func)->GetArgc() != As<Symbol>(first_)->GetArgc()) {
+            auto args = CollectArgs(As<Function>(func), As<LambdaInvoker>(func)->GetArgc(), scope);
             auto res = As<LambdaInvoker>(func)->Apply(args, scope);
 
             if (!Is<LambdaInvoker>(res)) {
                 throw RuntimeError("Wrong number of arguments");
             } else {
-                args = As<LambdaInvoker>(res)->CollectArgs(GetSecond(), scope);
+                args = CollectArgs(As<Function>(res), As<LambdaInvoker>(res)->GetArgc(), scope);
                 return As<LambdaInvoker>(res)->Apply(args, scope);
             }
         }
     }
 
-    if (Is<Function>(func)) {
-        auto args = As<Function>(func)->CollectArgs(GetSecond(), scope);
-        return As<Function>(func)->Apply(args, scope);
-    } else {
+    if (!Is<Function>(func)) {
         return func;
     }
+
+    // Lambdas know their own arity, builtins take it from the call site.
+    int argc = Is<LambdaInvoker>(func) ? As<LambdaInvoker>(func)->GetArgc()
+                                       : As<Symbol>(first_)->GetArgc();
+
+    if ((argc == 1 || argc == 2) && !Is<LambdaInvoker>(func) &&
+        As<Function>(func)->GetArgumentKind() == ArgumentKind::kEval) {
+        Object* args[2];
+        CollectArgs(As<Function>(func), argc, scope, args);
+        if (argc == 1) {
+            return As<Function>(func)->ApplyUnary(args[0], scope);
+        }
+        return As<Function>(func)->ApplyBinary(args[0], args[1], scope);
+    }
+
+    auto args = CollectArgs(As<Function>(func), argc, scope);
+
+    if (Is<LambdaInvoker>(func)) {
+        tail->invoker = As<LambdaInvoker>(func);
+        tail->args = std::move(args);
+        return nullptr;
+    }
+
+    if (Is<If>(func)) {
+        auto selected = As<If>(func)->SelectBranch(args, scope);
+        if (selected == nullptr) {
+            return Heap::GetHeap().GetEmptyList();
+        }
+        if (Is<CallCell>(selected)) {
+            *branch = selected;
+            return nullptr;
+        }
+        return EvalObject(selected, scope);
+    }
+
+    return As<Function>(func)->Apply(args, scope);
+}
+
+Object* Cell::EvalHead(Scope* scope) {
+    auto head = As<Symbol>(first_);
+    if (head == nullptr) {
+        return EvalObject(first_, scope);
+    }
+
+    auto site = FindSite();
+    if (site != nullptr && site->cache.version == Scope::GetBuiltinVersion()) {
+        return site->cache.callee;
+    }
+
+    // Binding the name of a builtin in the global frame changes the version,
+    // so a global head that gave its builtin keeps giving it until then.
+    // Frames of calls never hold the binding a global head looks up.
+    auto callee = head->Eval(scope);
+    if (site != nullptr && Is<Function>(callee) && !Is<LambdaInvoker>(callee) &&
+        head->GetAddress().kind == LexicalAddress::Kind::kGlobal &&
+        callee == FindBuiltin(head->GetId())) {
+        site->cache = {Scope::GetBuiltinVersion(), callee};
+    }
+    return callee;
 }
 
 std::string Cell::ToString() {
@@ -210,7 +343,15 @@ int Symbol::GetArgc() const {
     return argc_;
 }
 
-Function::Function(int argc) : argc_(argc) {
+void Symbol::SetAddress(LexicalAddress address) {
+    address_ = address;
+}
+
+const LexicalAddress& Symbol::GetAddress() const {
+    return address_;
+}
+
+Function::Function(ObjectType type) : Object(type) {
 }
 
 Object* Function::Eval(Scope* scope) {
@@ -221,125 +362,101 @@ std::string Function::ToString() {
     throw RuntimeError("Something wrong");
 }
 
-namespace {
-int GetArgc(Object* root, int cnt) {
-    int ans = cnt;
-    for (int i = 0; i < cnt; i++) {
-        auto left = As<Cell>(root)->GetFirst();
-        if (Is<Symbol>(left)) {
-            int temp = GetArgc(As<Cell>(root)->GetSecond(), As<Symbol>(left)->GetArgc());
-            ans += temp;
-            for (int j = 0; j < temp; j++) {
-                root = As<Cell>(root)->GetSecond();
-            }
-        }
-
-        if (Is<Cell>(root)) {
-            root = As<Cell>(root)->GetSecond();
-        } else if (i + 1 != cnt) {
-            throw RuntimeError("function no eval error");
-        }
-    }
+Object* Function::ApplyUnary(Object* arg, Scope* scope) {
+    std::vector<Object*> args{arg};
+    return Apply(args, scope);
+}
 
-    return ans;
+Object* Function::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    std::vector<Object*> args{lhs, rhs};
+    return Apply(args, scope);
 }
-}  // namespace
 
-std::vector<Object*> FunctionNoEval::CollectArgs(Object* root, Scope* scope) {
-    std::vector<Object*> result;
+ArgumentKind FunctionEval::GetArgumentKind() {
+    return ArgumentKind::kEval;
+}
 
-    try {
-        for (int i = 0; i < argc_; i++) {
-            if (!Is<Cell>(root) && !Is<LambdaCell>(root)) {
-                throw RuntimeError("func no eval isn't cell");
-            }
+ArgumentKind FunctionNoEval::GetArgumentKind() {
+    return ArgumentKind::kNoEval;
+}
 
-            if (Is<LambdaCell>(root)) {
-                result.push_back(root);
-            } else {
-                auto left = As<Cell>(root)->GetFirst();
-                if (Is<Symbol>(left)) {
-                    result.push_back(root);
-                    int temp = GetArgc(As<Cell>(root)->GetSecond(), As<Symbol>(left)->GetArgc());
-                    for (int j = 0; j < temp; j++) {
-                        root = As<Cell>(root)->GetSecond();
-                    }
-                } else {
-                    result.push_back(As<Cell>(root)->GetFirst());
-                }
-            }
+ArgumentKind QuoteFunction::GetArgumentKind() {
+    return ArgumentKind::kQuote;
+}
 
-            if (Is<Cell>(root)) {
-                root = As<Cell>(root)->GetSecond();
-            } else if (i + 1 != argc_) {
-                throw RuntimeError("function no eval error");
-            }
+namespace {
+const char* ArgumentError(ArgumentKind kind) {
+    if (kind == ArgumentKind::kEval) {
+        return "function eval error unknown";
+    } else if (kind == ArgumentKind::kNoEval) {
+        return "unknown exception function no eval";
+    }
+    return "Something wrong";
+}
+
+// The argument of a call site as a function of the given kind gets it. The
+// code of a cell evaluates arguments the same way, see
+// Code::CompileArgument.
+Object* CollectArgument(ArgumentKind kind, Object* arg, Scope* scope) {
+    auto left = Is<Cell>(arg) ? As<Cell>(arg)->GetFirst() : nullptr;
+    if (kind == ArgumentKind::kNoEval) {
+        if (auto value = Unevaluated(arg)) {
+            return value;
         }
-    } catch (...) {
-        throw RuntimeError("unknown exception function no eval");
+    } else if (kind == ArgumentKind::kQuote) {
+        if (Is<Cell>(arg)) {
+            return left;
+        }
+    } else if (Is<Symbol>(left) && As<Symbol>(left)->GetArgc() == 0) {
+        auto value = left->Eval(scope);
+        return Is<Function>(value) ? arg->Eval(scope) : value;
+    } else if (Is<Symbol>(left)) {
+        return arg->Eval(scope);
+    } else if (left != nullptr) {
+        return EvalObject(left, scope);
     }
-
-    return result;
+    throw RuntimeError(ArgumentError(kind));
 }
 
-std::vector<Object*> FunctionEval::CollectArgs(Object* root, Scope* scope) {
-    std::vector<Object*> result;
-
+// Lambdas may ask for more arguments than the call site has. Errors of
+// evaluated arguments are reported as the call's.
+void CollectArguments(ArgumentKind kind, const std::vector<Object*>& args, int argc,
+                      Scope* scope, Object** out) {
     try {
-        for (int i = 0; i < argc_; i++) {
-            if (!Is<Cell>(root)) {
-                throw RuntimeError("func eval isn't cell");
-            }
-
-            auto left = As<Cell>(root)->GetFirst();
-            if (Is<Symbol>(left)) {
-                result.push_back(root->Eval(scope));
-                int temp = GetArgc(As<Cell>(root)->GetSecond(), As<Symbol>(left)->GetArgc());
-                for (int j = 0; j < temp; j++) {
-                    root = As<Cell>(root)->GetSecond();
-                }
-            } else if (As<Cell>(root)->GetFirst() != nullptr) {
-                result.push_back(As<Cell>(root)->GetFirst()->Eval(scope));
-            } else {
-                throw RuntimeError("Missing argument");
-            }
-
-            if (Is<Cell>(root)) {
-                root = As<Cell>(root)->GetSecond();
-            } else if (i + 1 != argc_) {
-                throw RuntimeError("function eval error");
+        for (size_t i = 0; i < static_cast<size_t>(argc); i++) {
+            if (i == args.size()) {
+                throw RuntimeError(ArgumentError(kind));
             }
+            out[i] = CollectArgument(kind, args[i], scope);
         }
     } catch (...) {
-        throw RuntimeError("function eval error unknown");
+        if (kind != ArgumentKind::kEval) {
+            throw;
+        }
+        throw RuntimeError(ArgumentError(kind));
     }
-
-    return result;
 }
+}  // namespace
 
-std::vector<Object*> QuoteFunction::CollectArgs(Object* root, Scope* scope) {
-    std::vector<Object*> result;
-
-    try {
-        for (int i = 0; i < argc_; i++) {
-            if (!Is<Cell>(root)) {
-                throw RuntimeError("Something wrong");
-            }
-            result.push_back(As<Cell>(root)->GetFirst());
-            root = As<Cell>(root)->GetSecond();
-        }
-    } catch (...) {
-        throw RuntimeError("Something wrong");
-    }
+std::vector<Object*> Cell::CollectArgs(Function* func, int argc, Scope* scope) {
+    std::vector<Object*> args(argc);
+    CollectArgs(func, argc, scope, args.data());
+    return args;
+}
 
-    return result;
+void Cell::CollectArgs(Function* func, int argc, Scope* scope, Object** args) {
+    CollectArguments(func->GetArgumentKind(), GetArguments(), argc, scope, args);
 }
 
 Object* QuoteFunction::Apply(std::vector<Object*>& args, Scope* scope) {
+    if (args.size() == 2 && args[0] == Heap::GetHeap().GetOpenBracket() &&
+        args[1] == Heap::GetHeap().GetCloseBracket()) {
+        return Heap::GetHeap().GetEmptyList();
+    }
     return Heap::GetHeap().Allocate<List>(args);
 }
 
-List::List(const std::vector<Object*>& state) : state_(state) {
+List::List(const std::vector<Object*>& state) : Object(ObjectType::kList), state_(state) {
 }
 
 std::string List::ToString() {
@@ -354,14 +471,14 @@ std::string List::ToString() {
 
             if (Is<FakeNumber>(cur) && this->Size() > 1) {
                 res += " . ";
-                res += cur->ToString();
+                res += ObjectToString(cur);
                 continue;
             }
 
-            if (i > 0 && cur->ToString() != ")" && res.back() != '(') {
+            if (i > 0 && cur != Heap::GetHeap().GetCloseBracket() && res.back() != '(') {
                 res += " ";
             }
-            res += cur->ToString();
+            res += ObjectToString(cur);
         }
     } catch (...) {
         throw RuntimeError("Something went wrong");
@@ -379,7 +496,7 @@ Object* IsNumber::Apply(std::vector<Object*>& args, Scope* scope) {
         throw RuntimeError("number? invalid args");
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(Is<Number>(args[0]));
+    return Heap::GetHeap().GetBoolean(Is<Number>(args[0]));
 }
 
 Object* IsBoolean::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -387,12 +504,19 @@ Object* IsBoolean::Apply(std::vector<Object*>& args, Scope* scope) {
         throw RuntimeError("boolean? invalid args");
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(Is<Boolean>(args[0]));
+    return Heap::GetHeap().GetBoolean(Is<Boolean>(args[0]));
 }
 
 namespace {
 bool IsTrue(Object* obj) {
-    return !Is<Boolean>(obj) || (Is<Boolean>(obj) && As<Boolean>(obj)->GetValue());
+    return obj != Heap::GetHeap().GetBoolean(false);
+}
+
+int64_t GetNumberValue(Object* obj, const char* error) {
+    if (!Is<Number>(obj)) {
+        throw RuntimeError(error);
+    }
+    return GetInteger(obj);
 }
 }  // namespace
 
@@ -401,12 +525,16 @@ Object* Not::Apply(std::vector<Object*>& args, Scope* scope) {
         throw RuntimeError("not invalid args");
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(!IsTrue(args[0]));
+    return Heap::GetHeap().GetBoolean(!IsTrue(args[0]));
+}
+
+Object* Not::ApplyUnary(Object* arg, Scope* scope) {
+    return Heap::GetHeap().GetBoolean(!IsTrue(arg));
 }
 
 Object* Equal::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.empty()) {
-        return Heap::GetHeap().Allocate<Boolean>(true);
+        return Heap::GetHeap().GetBoolean(true);
     }
 
     auto first = args[0];
@@ -418,17 +546,23 @@ Object* Equal::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("= invalid args");
         }
 
-        if (As<Number>(first)->GetValue() != As<Number>(cur)->GetValue()) {
-            return Heap::GetHeap().Allocate<Boolean>(false);
+        if (GetInteger(first) != GetInteger(cur)) {
+            return Heap::GetHeap().GetBoolean(false);
         }
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+Object* Equal::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "= invalid args");
+    auto right = GetNumberValue(rhs, "= invalid args");
+    return Heap::GetHeap().GetBoolean(left == right);
 }
 
 Object* Less::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.empty()) {
-        return Heap::GetHeap().Allocate<Boolean>(true);
+        return Heap::GetHeap().GetBoolean(true);
     }
 
     auto first = args[0];
@@ -440,18 +574,24 @@ Object* Less::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("< invalid args");
         }
 
-        if (i > 0 && As<Number>(first)->GetValue() >= As<Number>(cur)->GetValue()) {
-            return Heap::GetHeap().Allocate<Boolean>(false);
+        if (i > 0 && GetInteger(first) >= GetInteger(cur)) {
+            return Heap::GetHeap().GetBoolean(false);
         }
         first = cur;
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+Object* Less::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "< invalid args");
+    auto right = GetNumberValue(rhs, "< invalid args");
+    return Heap::GetHeap().GetBoolean(left < right);
 }
 
 Object* Greater::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.empty()) {
-        return Heap::GetHeap().Allocate<Boolean>(true);
+        return Heap::GetHeap().GetBoolean(true);
     }
 
     auto first = args[0];
@@ -463,18 +603,24 @@ Object* Greater::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("> invalid args");
         }
 
-        if (i > 0 && As<Number>(first)->GetValue() <= As<Number>(cur)->GetValue()) {
-            return Heap::GetHeap().Allocate<Boolean>(false);
+        if (i > 0 && GetInteger(first) <= GetInteger(cur)) {
+            return Heap::GetHeap().GetBoolean(false);
         }
         first = cur;
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+Object* Greater::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "> invalid args");
+    auto right = GetNumberValue(rhs, "> invalid args");
+    return Heap::GetHeap().GetBoolean(left > right);
 }
 
 Object* LessEqual::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.empty()) {
-        return Heap::GetHeap().Allocate<Boolean>(true);
+        return Heap::GetHeap().GetBoolean(true);
     }
 
     auto first = args[0];
@@ -486,18 +632,24 @@ Object* LessEqual::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("<= invalid args");
         }
 
-        if (i > 0 && As<Number>(first)->GetValue() > As<Number>(cur)->GetValue()) {
-            return Heap::GetHeap().Allocate<Boolean>(false);
+        if (i > 0 && GetInteger(first) > GetInteger(cur)) {
+            return Heap::GetHeap().GetBoolean(false);
         }
         first = cur;
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+Object* LessEqual::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "<= invalid args");
+    auto right = GetNumberValue(rhs, "<= invalid args");
+    return Heap::GetHeap().GetBoolean(left <= right);
 }
 
 Object* GreaterEqual::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.empty()) {
-        return Heap::GetHeap().Allocate<Boolean>(true);
+        return Heap::GetHeap().GetBoolean(true);
     }
 
     auto first = args[0];
@@ -509,13 +661,19 @@ Object* GreaterEqual::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError(">= invalid args");
         }
 
-        if (i > 0 && As<Number>(first)->GetValue() < As<Number>(cur)->GetValue()) {
-            return Heap::GetHeap().Allocate<Boolean>(false);
+        if (i > 0 && GetInteger(first) < GetInteger(cur)) {
+            return Heap::GetHeap().GetBoolean(false);
         }
         first = cur;
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+Object* GreaterEqual::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, ">= invalid args");
+    auto right = GetNumberValue(rhs, ">= invalid args");
+    return Heap::GetHeap().GetBoolean(left >= right);
 }
 
 Object* Sum::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -528,10 +686,16 @@ Object* Sum::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("+ invalid args");
         }
 
-        res += As<Number>(cur)->GetValue();
+        res += GetInteger(cur);
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Sum::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "+ invalid args");
+    auto right = GetNumberValue(rhs, "+ invalid args");
+    return Heap::GetHeap().GetNumber(left + right);
 }
 
 Object* Difference::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -549,13 +713,19 @@ Object* Difference::Apply(std::vector<Object*>& args, Scope* scope) {
         }
 
         if (i == 0) {
-            res += As<Number>(cur)->GetValue();
+            res += GetInteger(cur);
         } else {
-            res -= As<Number>(cur)->GetValue();
+            res -= GetInteger(cur);
         }
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Difference::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "- invalid args");
+    auto right = GetNumberValue(rhs, "- invalid args");
+    return Heap::GetHeap().GetNumber(left - right);
 }
 
 Object* Product::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -568,10 +738,16 @@ Object* Product::Apply(std::vector<Object*>& args, Scope* scope) {
             throw RuntimeError("* invalid args");
         }
 
-        res *= As<Number>(cur)->GetValue();
+        res *= GetInteger(cur);
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Product::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "* invalid args");
+    auto right = GetNumberValue(rhs, "* invalid args");
+    return Heap::GetHeap().GetNumber(left * right);
 }
 
 Object* Division::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -589,13 +765,19 @@ Object* Division::Apply(std::vector<Object*>& args, Scope* scope) {
         }
 
         if (i == 0) {
-            res += As<Number>(cur)->GetValue();
+            res += GetInteger(cur);
         } else {
-            res /= As<Number>(cur)->GetValue();
+            res /= GetInteger(cur);
         }
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Division::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "/ invalid args");
+    auto right = GetNumberValue(rhs, "/ invalid args");
+    return Heap::GetHeap().GetNumber(left / right);
 }
 
 Object* Max::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -613,13 +795,19 @@ Object* Max::Apply(std::vector<Object*>& args, Scope* scope) {
         }
 
         if (i == 0) {
-            res = As<Number>(cur)->GetValue();
+            res = GetInteger(cur);
         } else {
-            res = std::max(res, As<Number>(cur)->GetValue());
+            res = std::max(res, GetInteger(cur));
         }
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Max::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "max invalid args");
+    auto right = GetNumberValue(rhs, "max invalid args");
+    return Heap::GetHeap().GetNumber(std::max(left, right));
 }
 
 Object* Min::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -637,13 +825,19 @@ Object* Min::Apply(std::vector<Object*>& args, Scope* scope) {
         }
 
         if (i == 0) {
-            res = As<Number>(cur)->GetValue();
+            res = GetInteger(cur);
         } else {
-            res = std::min(res, As<Number>(cur)->GetValue());
+            res = std::min(res, GetInteger(cur));
         }
     }
 
-    return Heap::GetHeap().Allocate<Number>(res);
+    return Heap::GetHeap().GetNumber(res);
+}
+
+Object* Min::ApplyBinary(Object* lhs, Object* rhs, Scope* scope) {
+    auto left = GetNumberValue(lhs, "min invalid args");
+    auto right = GetNumberValue(rhs, "min invalid args");
+    return Heap::GetHeap().GetNumber(std::min(left, right));
 }
 
 Object* Abs::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -656,12 +850,16 @@ Object* Abs::Apply(std::vector<Object*>& args, Scope* scope) {
         throw RuntimeError("abs invalid argument");
     }
 
-    return Heap::GetHeap().Allocate<Number>(std::abs(As<Number>(arg)->GetValue()));
+    return Heap::GetHeap().GetNumber(std::abs(GetInteger(arg)));
+}
+
+Object* Abs::ApplyUnary(Object* arg, Scope* scope) {
+    return Heap::GetHeap().GetNumber(std::abs(GetNumberValue(arg, "abs invalid argument")));
 }
 
 Object* And::Apply(std::vector<Object*>& args, Scope* scope) {
     for (size_t i = 0; i < args.size(); i++) {
-        auto cur = args[i]->Eval(scope);
+        auto cur = EvalObject(args[i], scope);
         if (!IsTrue(cur)) {
             return cur;
         }
@@ -669,12 +867,12 @@ Object* And::Apply(std::vector<Object*>& args, Scope* scope) {
             return cur;
         }
     }
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
 }
 
 Object* Or::Apply(std::vector<Object*>& args, Scope* scope) {
     for (size_t i = 0; i < args.size(); i++) {
-        auto cur = args[i]->Eval(scope);
+        auto cur = EvalObject(args[i], scope);
         if (IsTrue(cur)) {
             return cur;
         }
@@ -682,17 +880,12 @@ Object* Or::Apply(std::vector<Object*>& args, Scope* scope) {
             return cur;
         }
     }
-    return Heap::GetHeap().Allocate<Boolean>(false);
+    return Heap::GetHeap().GetBoolean(false);
 }
 
 bool List::IsObject(size_t i) {
-    if (Is<Symbol>(state_[i])) {
-        auto ch = As<Symbol>(state_[i])->GetName();
-        if (ch == "(" || ch == ")") {
-            return false;
-        }
-    }
-    return true;
+    return state_[i] != Heap::GetHeap().GetOpenBracket() &&
+           state_[i] != Heap::GetHeap().GetCloseBracket();
 }
 
 int List::Size() {
@@ -705,29 +898,29 @@ int List::Size() {
 
 Object* IsPair::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.size() != 1 || !Is<List>(args[0])) {
-        return Heap::GetHeap().Allocate<Boolean>(false);
+        return Heap::GetHeap().GetBoolean(false);
     }
 
     auto list = As<List>(args[0]);
-    return Heap::GetHeap().Allocate<Boolean>(list->Size() == 2);
+    return Heap::GetHeap().GetBoolean(list->Size() == 2);
 }
 
 Object* IsNull::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.size() != 1 || !Is<List>(args[0])) {
-        return Heap::GetHeap().Allocate<Boolean>(false);
+        return Heap::GetHeap().GetBoolean(false);
     }
 
     auto list = As<List>(args[0]);
-    return Heap::GetHeap().Allocate<Boolean>(list->Size() == 0);
+    return Heap::GetHeap().GetBoolean(list->Size() == 0);
 }
 
 Object* IsList::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.size() != 1 || !Is<List>(args[0])) {
-        return Heap::GetHeap().Allocate<Boolean>(false);
+        return Heap::GetHeap().GetBoolean(false);
     }
 
     auto list = As<List>(args[0]);
-    return Heap::GetHeap().Allocate<Boolean>(!list->IsMalformed());
+    return Heap::GetHeap().GetBoolean(!list->IsMalformed());
 }
 
 bool List::IsMalformed() {
@@ -747,17 +940,17 @@ Object* MakePair::Apply(std::vector<Object*>& args, Scope* scope) {
     std::vector<Object*> list;
     list.reserve(4);
 
-    list.push_back(Heap::GetHeap().Allocate<Symbol>("("));
+    list.push_back(Heap::GetHeap().GetOpenBracket());
 
     list.push_back(args[0]);
 
     if (Is<Number>(args[1])) {
-        list.push_back(Heap::GetHeap().Allocate<FakeNumber>(As<Number>(args[1])->GetValue()));
+        list.push_back(Heap::GetHeap().Allocate<FakeNumber>(GetInteger(args[1])));
     } else {
         list.push_back(args[1]);
     }
 
-    list.push_back(Heap::GetHeap().Allocate<Symbol>(")"));
+    list.push_back(Heap::GetHeap().GetCloseBracket());
     return Heap::GetHeap().Allocate<List>(list);
 }
 
@@ -812,13 +1005,13 @@ Object* Tail::Apply(std::vector<Object*>& args, Scope* scope) {
     }
 
     std::vector<Object*> new_list;
-    new_list.push_back(Heap::GetHeap().Allocate<Symbol>("("));
+    new_list.push_back(Heap::GetHeap().GetOpenBracket());
 
     for (int i = 1; i < list->Size(); i++) {
         new_list.push_back(list->Get(i));
     }
 
-    new_list.push_back(Heap::GetHeap().Allocate<Symbol>(")"));
+    new_list.push_back(Heap::GetHeap().GetCloseBracket());
     return Heap::GetHeap().Allocate<List>(new_list);
 }
 
@@ -826,7 +1019,7 @@ Object* MakeList::Apply(std::vector<Object*>& args, Scope* scope) {
     std::vector<Object*> list;
     list.reserve(args.size() + 2);
 
-    list.push_back(Heap::GetHeap().Allocate<Symbol>("("));
+    list.push_back(Heap::GetHeap().GetOpenBracket());
 
     for (int i = 0; i < args.size(); i++) {
         auto cur = args[i];
@@ -836,7 +1029,7 @@ Object* MakeList::Apply(std::vector<Object*>& args, Scope* scope) {
         list.push_back(cur);
     }
 
-    list.push_back(Heap::GetHeap().Allocate<Symbol>(")"));
+    list.push_back(Heap::GetHeap().GetCloseBracket());
     return Heap::GetHeap().Allocate<List>(list);
 }
 
@@ -846,13 +1039,11 @@ Object* ListRef::Apply(std::vector<Object*>& args, Scope* scope) {
     }
 
     auto list = As<List>(args[0]);
-    auto index = As<Number>(args[1]);
-
-    if (!list || !index || list->Size() <= index->GetValue()) {
+    if (!list || !Is<Number>(args[1]) || list->Size() <= GetInteger(args[1])) {
         throw RuntimeError("list-ref invalid arguments");
     }
 
-    return list->Get(index->GetValue());
+    return list->Get(GetInteger(args[1]));
 }
 
 Object* ListTail::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -861,41 +1052,82 @@ Object* ListTail::Apply(std::vector<Object*>& args, Scope* scope) {
     }
 
     auto list = As<List>(args[0]);
-    auto index = As<Number>(args[1]);
-
-    if (!list || !index || list->Size() < index->GetValue()) {
+    if (!list || !Is<Number>(args[1]) || list->Size() < GetInteger(args[1])) {
         throw RuntimeError("list-ref invalid arguments");
     }
 
     std::vector<Object*> new_list;
-    new_list.push_back(Heap::GetHeap().Allocate<Symbol>("("));
+    new_list.push_back(Heap::GetHeap().GetOpenBracket());
 
-    for (int i = index->GetValue(); i < list->Size(); i++) {
+    for (int i = GetInteger(args[1]); i < list->Size(); i++) {
         new_list.push_back(list->Get(i));
     }
 
-    new_list.push_back(Heap::GetHeap().Allocate<Symbol>(")"));
+    new_list.push_back(Heap::GetHeap().GetCloseBracket());
     return Heap::GetHeap().Allocate<List>(new_list);
 }
 
 Object* IsSymbol::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.size() != 1 || !Is<List>(args[0])) {
-        return Heap::GetHeap().Allocate<Boolean>(false);
+        return Heap::GetHeap().GetBoolean(false);
     }
 
     auto list = As<List>(args[0]);
-    return Heap::GetHeap().Allocate<Boolean>(list->Size() == 1 && Is<Symbol>(list->Get(0)));
+    return Heap::GetHeap().GetBoolean(list->Size() == 1 && Is<Symbol>(list->Get(0)));
+}
+
+int Scope::Find(SymbolId key) {
+    if (!(filter_ & FilterBit(key))) {
+        return -1;
+    }
+
+    if (index_) {
+        auto it = index_->find(key);
+        return it == index_->end() ? -1 : it->second;
+    }
+    for (size_t slot = 0; slot < slots_.size(); ++slot) {
+        if (slots_[slot].first == key) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void Scope::Insert(SymbolId key, Object* obj) {
+    if (prev_scope_ == nullptr && FindBuiltin(key) != nullptr) {
+        ++builtin_version_;
+    }
+    Heap::GetHeap().WriteBarrier(this, nullptr, obj);
+    filter_ |= FilterBit(key);
+    slots_.emplace_back(key, obj);
+
+    if (index_) {
+        index_->emplace(key, slots_.size() - 1);
+    } else if (slots_.size() > kIndexedSize) {
+        index_ = std::make_unique<std::unordered_map<SymbolId, uint32_t>>();
+        for (size_t slot = 0; slot < slots_.size(); ++slot) {
+            index_->emplace(slots_[slot].first, slot);
+        }
+    }
 }
 
-Object* Scope::Get(const std::string& key) {
-    if (map_.contains(key)) {
-        return map_[key];
+void Scope::Set(size_t slot, Object* obj) {
+    if (prev_scope_ == nullptr && FindBuiltin(slots_[slot].first) != nullptr) {
+        ++builtin_version_;
+    }
+    Heap::GetHeap().WriteBarrier(this, slots_[slot].second, obj);
+    slots_[slot].second = obj;
+}
+
+Object* Scope::Get(SymbolId key) {
+    if (int slot = Find(key); slot != -1) {
+        return slots_[slot].second;
     }
 
     auto scope = prev_scope_;
     while (scope != nullptr && &(*scope) != this) {
-        if (scope->map_.contains(key)) {
-            return scope->map_[key];
+        if (int slot = scope->Find(key); slot != -1) {
+            return scope->slots_[slot].second;
         }
         scope = scope->prev_scope_;
     }
@@ -903,27 +1135,56 @@ Object* Scope::Get(const std::string& key) {
     return nullptr;
 }
 
-bool Scope::Add(const std::string& key, Object* obj, bool force_add) {
+Object* Scope::Get(SymbolId key, LexicalAddress* address) {
+    if (address->kind == LexicalAddress::Kind::kLocal) {
+        Scope* scope = this;
+        for (uint32_t depth = 0; depth < address->depth; ++depth) {
+            scope = scope->prev_scope_;
+        }
+        return scope->slots_[address->slot].second;
+    }
+
+    if (address->kind == LexicalAddress::Kind::kGlobal) {
+        // Frames only nest as deep as the lambdas around the name.
+        Scope* global = this;
+        while (global->prev_scope_ != nullptr) {
+            global = global->prev_scope_;
+        }
+        auto& slots = global->slots_;
+        if (address->slot < slots.size() && slots[address->slot].first == key) {
+            return slots[address->slot].second;
+        }
+        int slot = global->Find(key);
+        if (slot == -1) {
+            return nullptr;
+        }
+        address->slot = slot;
+        return slots[slot].second;
+    }
+    return Get(key);
+}
+
+bool Scope::Add(SymbolId key, Object* obj, bool force_add) {
     auto temp = Get(key);
     if (temp == nullptr && force_add) {
         return false;
     }
 
-    if (map_.contains(key)) {
-        map_[key] = obj;
+    if (int slot = Find(key); slot != -1) {
+        Set(slot, obj);
         return true;
     }
 
     auto scope = prev_scope_;
     while (scope != nullptr && &(*scope) != this) {
-        if (scope->map_.contains(key)) {
-            scope->map_[key] = obj;
+        if (int slot = scope->Find(key); slot != -1) {
+            scope->Set(slot, obj);
             return true;
         }
         scope = scope->prev_scope_;
     }
 
-    map_[key] = obj;
+    Insert(key, obj);
     return true;
 }
 
@@ -942,12 +1203,12 @@ Object* DefineVar::Apply(std::vector<Object*>& args, Scope* scope) {
     if (Is<Cell>(expr) && As<Cell>(expr)->GetSecond() == nullptr &&
         Is<Symbol>(As<Cell>(expr)->GetFirst()) &&
         IsArithmetic(As<Symbol>(As<Cell>(expr)->GetFirst())->GetName())) {
-        return Heap::GetHeap().Allocate<Boolean>(
-            scope->Add(symbol->GetName(), As<Cell>(expr)->GetFirst(), false));
+        return Heap::GetHeap().GetBoolean(
+            scope->Add(symbol->GetId(), As<Cell>(expr)->GetFirst(), false));
     }
 
-    return Heap::GetHeap().Allocate<Boolean>(
-        scope->Add(symbol->GetName(), expr->Eval(scope), false));
+    return Heap::GetHeap().GetBoolean(
+        scope->Add(symbol->GetId(), EvalObject(expr, scope), false));
 }
 
 Object* SetVar::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -962,11 +1223,11 @@ Object* SetVar::Apply(std::vector<Object*>& args, Scope* scope) {
         throw RuntimeError("set! invalid arguments");
     }
 
-    auto res = scope->Add(symbol->GetName(), expr->Eval(scope), true);
+    auto res = scope->Add(symbol->GetId(), EvalObject(expr, scope), true);
     if (!res) {
         throw NameError("Variable " + symbol->GetName() + " not exist");
     }
-    return Heap::GetHeap().Allocate<Boolean>(res);
+    return Heap::GetHeap().GetBoolean(res);
 }
 
 void List::Set(size_t ind, Object* obj) {
@@ -977,6 +1238,7 @@ void List::Set(size_t ind, Object* obj) {
             cur += 1;
         }
         if (cur == ind + 1) {
+            Heap::GetHeap().WriteBarrier(this, state_[i], obj);
             state_[i] = obj;
             break;
         }
@@ -998,7 +1260,7 @@ Object* SetHead::Apply(std::vector<Object*>& args, Scope* scope) {
     }
 
     list->Set(0, args[1]);
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
 }
 
 Object* SetTail::Apply(std::vector<Object*>& args, Scope* scope) {
@@ -1017,30 +1279,38 @@ Object* SetTail::Apply(std::vector<Object*>& args, Scope* scope) {
     }
 
     if (Is<Number>(args[1])) {
-        args[1] = Heap::GetHeap().Allocate<FakeNumber>(As<Number>(args[1])->GetValue());
+        args[1] = Heap::GetHeap().Allocate<FakeNumber>(GetInteger(args[1]));
     }
 
     list->Set(1, args[1]);
-    return Heap::GetHeap().Allocate<Boolean>(true);
+    return Heap::GetHeap().GetBoolean(true);
+}
+
+If::If() : FunctionNoEval(ObjectType::kIf) {
 }
 
 Object* If::Apply(std::vector<Object*>& args, Scope* scope) {
+    auto branch = SelectBranch(args, scope);
+    if (branch == nullptr) {
+        return Heap::GetHeap().GetEmptyList();
+    }
+    return EvalObject(branch, scope);
+}
+
+Object* If::SelectBranch(std::vector<Object*>& args, Scope* scope) {
     if (args.size() <= 1 || args.size() > 3) {
         throw SyntaxError("If wrong number of arguments");
     }
 
-    bool res = IsTrue(args[0]->Eval(scope));
+    bool res = IsTrue(EvalObject(args[0], scope));
     if (res) {
-        return args[1]->Eval(scope);
+        return args[1];
     }
     if (args.size() == 2) {
-        std::vector<Object*> list;
-        list.push_back(Heap::GetHeap().Allocate<Symbol>("("));
-        list.push_back(Heap::GetHeap().Allocate<Symbol>(")"));
-        return Heap::GetHeap().Allocate<List>(list);
+        return nullptr;
     }
 
-    return args[2]->Eval(scope);
+    return args[2];
 }
 
 int LambdaSymbol::GetVarc() const {
@@ -1055,69 +1325,97 @@ std::string LambdaCell::ToString() {
     return "wrong";
 }
 
-LambdaCell::LambdaCell(Object* first) : first_(first), second_(nullptr) {
+LambdaCell::LambdaCell(Object* first)
+    : Object(ObjectType::kLambdaCell), first_(first), second_(nullptr) {
 }
 
 void LambdaCell::SetFirst(Object* ptr) {
+    Heap::GetHeap().WriteBarrier(this, first_, ptr);
     first_ = ptr;
 }
 
 void LambdaCell::SetSecond(Object* ptr) {
+    Heap::GetHeap().WriteBarrier(this, second_, ptr);
     second_ = ptr;
 }
 
-LambdaFunction::LambdaFunction(int argc, int argv, Scope* scope)
-    : FunctionNoEval(argc), argv_(argv), scope_(scope) {
+Object* LambdaCell::GetFirst() const {
+    return first_;
 }
 
-Object* LambdaCell::Eval(Scope* scope) {
-    auto symb = As<LambdaSymbol>(first_);
-    auto func = As<Function>(
-        Heap::GetHeap().Allocate<LambdaFunction>(symb->GetArgc(), symb->GetVarc(), scope));
-    auto args = func->CollectArgs(second_, scope);
-    return func->Apply(args, scope);
+Object* LambdaCell::GetSecond() const {
+    return second_;
+}
+
+const std::vector<Object*>& LambdaCell::GetArguments() const {
+    return args_;
 }
 
-Object* LambdaFunction::Apply(std::vector<Object*>& args, Scope* scope) {
-    return Heap::GetHeap().Allocate<LambdaInvoker>(argv_, argc_, scope_, args);
+void LambdaCell::SetArguments(std::vector<Object*> args) {
+    args_ = std::move(args);
 }
 
-LambdaInvoker::LambdaInvoker(int argc, int argv, Scope* scope, std::vector<Object*>& state)
-    : FunctionEval(argc), argv_(argv), scope_(scope), state_(state) {
+const std::vector<Object*>& LambdaCell::GetBody() const {
+    return body_;
+}
+
+const Code& LambdaCell::GetCode() {
+    if (!code_) {
+        code_ = std::make_unique<Code>(this);
+    }
+    return *code_;
+}
+
+Object* LambdaCell::Eval(Scope* scope) {
+    auto symb = As<LambdaSymbol>(first_);
+    // The parser never makes a lambda without a body, so body_ is only
+    // empty before the first closure.
+    if (body_.empty()) {
+        body_.resize(symb->GetArgc());
+        CollectArguments(ArgumentKind::kNoEval, args_, symb->GetArgc(), scope, body_.data());
+    }
+    return Heap::GetHeap().Allocate<LambdaInvoker>(symb->GetVarc(), this, scope);
+}
+
+LambdaInvoker::LambdaInvoker(int argc, LambdaCell* lambda, Scope* scope)
+    : FunctionEval(ObjectType::kLambdaInvoker), argc_(argc), lambda_(lambda), scope_(scope) {
 }
 
 std::string LambdaInvoker::ToString() {
     std::vector<Object*> temp;
     auto res = LambdaInvoker::Apply(temp, scope_);
-    return res->ToString();
+    return ObjectToString(res);
 }
 
-Scope::Scope(Scope* scope) : prev_scope_(scope) {
+Scope::Scope(Scope* scope) : Object(ObjectType::kScope), prev_scope_(scope) {
 }
 
 Object* LambdaInvoker::Apply(std::vector<Object*>& args, Scope* scope) {
     if (args.size() != argc_) {
         throw RuntimeError("lambda invalid args");
     }
+    return lambda_->GetCode().Run(Bind(args.data()));
+}
 
+Scope* LambdaInvoker::Bind(Object** args) {
+    const auto& state = lambda_->GetBody();
     Scope* new_scope = As<Scope>(Heap::GetHeap().Allocate<Scope>(scope_));
-    for (int i = 0; i < args.size(); i++) {
-        new_scope->AddForce(As<Symbol>(As<Cell>(state_[i])->GetFirst())->GetName(), args[i]);
-    }
-
-    Object* result = nullptr;
-    for (int i = args.size(); i < state_.size(); i++) {
-        result = state_[i]->Eval(new_scope);
+    for (int i = 0; i < argc_; i++) {
+        new_scope->AddForce(As<Symbol>(As<Cell>(state[i])->GetFirst())->GetId(), args[i]);
     }
-    return result;
+    return new_scope;
 }
 
 Object* LambdaInvoker::Eval(Scope* scope) {
-    return Heap::GetHeap().Allocate<LambdaInvoker>(*this);
+    return this;
 }
 
-bool Scope::AddForce(const std::string& key, Object* obj) {
-    map_[key] = obj;
+bool Scope::AddForce(SymbolId key, Object* obj) {
+    if (int slot = Find(key); slot != -1) {
+        Set(slot, obj);
+    } else {
+        Insert(key, obj);
+    }
     return true;
 }
 
@@ -1125,27 +1423,18 @@ int LambdaInvoker::GetArgc() {
     return argc_;
 }
 
-void Object::Mark() {
-    marked_ = true;
+LambdaCell* LambdaInvoker::GetLambda() {
+    return lambda_;
 }
 
-void Object::Unmark() {
-    marked_ = false;
+void Object::MarkChildren(Heap* heap) {
 }
 
-void Scope::Mark() {
-    if (marked_) {
-        return;
-    }
-
-    marked_ = true;
-    for (auto [k, v] : map_) {
-        v->Mark();
-    }
-
-    if (prev_scope_) {
-        prev_scope_->Mark();
+void Scope::MarkChildren(Heap* heap) {
+    for (auto [key, value] : slots_) {
+        heap->Mark(value);
     }
+    heap->Mark(prev_scope_);
 }
 
 Object* Scope::Eval(Scope* scope) {
@@ -1156,66 +1445,98 @@ std::string Scope::ToString() {
     throw RuntimeError("Can't serialize scope");
 }
 
-void Cell::Mark() {
-    if (marked_) {
-        return;
-    }
+void Cell::MarkChildren(Heap* heap) {
+    // The tail goes first so that walking a long list keeps the stack flat.
+    heap->Mark(GetSecond());
+    heap->Mark(GetFirst());
+}
 
-    marked_ = true;
-    if (GetFirst() != nullptr) {
-        GetFirst()->Mark();
-    }
-    if (GetSecond() != nullptr) {
-        GetSecond()->Mark();
+void CallCell::MarkChildren(Heap* heap) {
+    Cell::MarkChildren(heap);
+    if (site_) {
+        heap->Mark(site_->folded);
+        heap->Mark(site_->folded_callee);
     }
 }
 
-void LambdaCell::Mark() {
-    if (marked_) {
-        return;
-    }
+void LambdaCell::MarkChildren(Heap* heap) {
+    heap->Mark(second_);
+    heap->Mark(first_);
+}
 
-    marked_ = true;
-    if (first_ != nullptr) {
-        first_->Mark();
-    }
-    if (second_ != nullptr) {
-        second_->Mark();
+void List::MarkChildren(Heap* heap) {
+    for (auto obj : state_) {
+        heap->Mark(obj);
     }
 }
 
-void LambdaFunction::Mark() {
-    if (marked_) {
-        return;
-    }
+void LambdaInvoker::MarkChildren(Heap* heap) {
+    heap->Mark(lambda_);
+    heap->Mark(scope_);
+}
+
+namespace {
+Object* MakeBracketed(std::vector<Object*> items) {
+    items.insert(items.begin(), Heap::GetHeap().GetOpenBracket());
+    items.push_back(Heap::GetHeap().GetCloseBracket());
+    return Heap::GetHeap().Allocate<List>(items);
+}
 
-    marked_ = true;
-    if (scope_) {
-        scope_->Mark();
+Object* MakeEntry(const std::string& name, const std::vector<int64_t>& values) {
+    std::vector<Object*> entry;
+    entry.push_back(Heap::GetHeap().Allocate<Symbol>(name));
+    for (auto value : values) {
+        entry.push_back(Heap::GetHeap().GetNumber(value));
     }
+    return MakeBracketed(entry);
 }
 
-void List::Mark() {
-    if (marked_) {
-        return;
+int64_t Microseconds(Heap::Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+}  // namespace
+
+Object* GcStats::Apply(std::vector<Object*>& args, Scope* scope) {
+    if (!args.empty()) {
+        throw RuntimeError("gc-stats expects no arguments");
     }
 
-    marked_ = true;
-    for (auto obj : state_) {
-        obj->Mark();
+    auto stats = Heap::GetHeap().GetStats();
+    Heap::Clock::duration average{};
+    if (stats.pauses > 0) {
+        average = stats.total_pause / int64_t(stats.pauses);
     }
+    Heap::Clock::duration minor_average{};
+    if (stats.minor_collections > 0) {
+        minor_average = stats.total_minor_pause / int64_t(stats.minor_collections);
+    }
+
+    std::vector<Object*> entries;
+    entries.push_back(MakeEntry("reserved-bytes", {int64_t(stats.reserved_bytes)}));
+    entries.push_back(MakeEntry("live-objects", {int64_t(stats.live_objects)}));
+    entries.push_back(MakeEntry("live-bytes", {int64_t(stats.live_bytes)}));
+    entries.push_back(MakeEntry("allocated-bytes", {int64_t(stats.allocated_bytes)}));
+    entries.push_back(MakeEntry("allocation-rate", {int64_t(stats.allocation_rate)}));
+    entries.push_back(MakeEntry("minor-collections", {int64_t(stats.minor_collections)}));
+    entries.push_back(MakeEntry("full-collections", {int64_t(stats.full_collections)}));
+    entries.push_back(MakeEntry("last-pause-us", {Microseconds(stats.last_pause)}));
+    entries.push_back(MakeEntry("avg-pause-us", {Microseconds(average)}));
+    entries.push_back(MakeEntry("max-pause-us", {Microseconds(stats.max_pause)}));
+    entries.push_back(MakeEntry("last-minor-pause-us", {Microseconds(stats.last_minor_pause)}));
+    entries.push_back(MakeEntry("avg-minor-pause-us", {Microseconds(minor_average)}));
+    entries.push_back(MakeEntry("max-minor-pause-us", {Microseconds(stats.max_minor_pause)}));
+    entries.push_back(MakeEntry("last-mark-us", {Microseconds(stats.last_mark)}));
+    return MakeBracketed(entries);
 }
 
-void LambdaInvoker::Mark() {
-    if (marked_) {
-        return;
+Object* HeapHistogram::Apply(std::vector<Object*>& args, Scope* scope) {
+    if (!args.empty()) {
+        throw RuntimeError("heap-histogram expects no arguments");
     }
 
-    marked_ = true;
-    for (auto obj : state_) {
-        obj->Mark();
-    }
-    if (scope_) {
-        scope_->Mark();
+    std::vector<Object*> entries;
+    for (const auto& type : Heap::GetHeap().GetHistogram()) {
+        entries.push_back(MakeEntry(type.name, {int64_t(type.objects), int64_t(type.bytes)}));
     }
+    return MakeBracketed(entries);
 }
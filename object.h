@@ -4,38 +4,103 @@
 #include <vector>
 #include <unordered_map>
 
+#include "bytecode.h"
+#include "symbol_table.h"
+
 class Heap;
 class Scope;
 
-class Object {
-    friend class Heap;
+// Tags of the classes Is and As test for. Subclasses come right after their
+// base, so a class and its subclasses make up a range. Builtins without a
+// tag of their own are kFunction.
+enum class ObjectType : uint8_t {
+    kScope,
+    kNumber,
+    kFakeNumber,
+    kSymbol,
+    kLambdaSymbol,
+    kBoolean,
+    kCell,
+    kCallCell,
+    kLambdaCell,
+    kList,
+    kFunction,
+    kLambdaInvoker,
+    kIf,
+};
 
+class Object {
 public:
     virtual ~Object() = default;
     virtual Object* Eval(Scope* scope) = 0;
     virtual std::string ToString() = 0;
 
-    virtual void Mark();
-    virtual void Unmark();
+    virtual void MarkChildren(Heap* heap);
+
+    ObjectType GetType() const {
+        return type_;
+    }
 
 protected:
-    bool marked_ = false;
+    explicit Object(ObjectType type) : type_(type) {
+    }
+
+private:
+    ObjectType type_;
 };
 
+// Where a symbol finds its value, filled in by Resolve. A local name is in
+// the frame depth links up, at slot. A global one is in the outermost frame,
+// slot being where it was seen last, or a builtin. Names Resolve did not
+// place are looked for frame by frame.
+struct LexicalAddress {
+    enum class Kind : uint8_t { kDynamic, kGlobal, kLocal };
+
+    Kind kind = Kind::kDynamic;
+    uint32_t depth = 0;
+    uint32_t slot = 0;
+};
+
+// Frames keep their bindings in a flat array, bindings are never removed so
+// slots stay put. Only frames that grow large, like the global one, also get
+// a hash index.
 class Scope : public Object {
 public:
     Scope(Scope* scope = nullptr);
-    Object* Get(const std::string& key);
-    bool Add(const std::string& key, Object* obj, bool force_add);
-    bool AddForce(const std::string& key, Object* obj);
+    Object* Get(SymbolId key);
+    // Same as Get, but goes to the place address gives. A global name's
+    // slot is recorded in address once found, slots never move.
+    Object* Get(SymbolId key, LexicalAddress* address);
+    bool Add(SymbolId key, Object* obj, bool force_add);
+    bool AddForce(SymbolId key, Object* obj);
+
+    // Changes whenever the global frame binds the name of a builtin, never 0.
+    static uint64_t GetBuiltinVersion() {
+        return builtin_version_;
+    }
 
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
-    virtual void Mark() override;
+    virtual void MarkChildren(Heap* heap) override;
 
 private:
+    static constexpr size_t kIndexedSize = 16;
+
+    // One bit per key modulo 64, so most frames are skipped without a scan.
+    static uint64_t FilterBit(SymbolId key) {
+        return uint64_t(1) << (key % 64);
+    }
+
+    int Find(SymbolId key);
+    void Insert(SymbolId key, Object* obj);
+    void Set(size_t slot, Object* obj);
+
+    static inline uint64_t builtin_version_ = 1;
+
     Scope* prev_scope_;
-    std::unordered_map<std::string, Object*> map_;
+    uint64_t filter_ = 0;
+    std::vector<std::pair<SymbolId, Object*>> slots_;
+    std::unique_ptr<std::unordered_map<SymbolId, uint32_t>> index_;
 };
 
 class Number : public Object {
@@ -45,34 +110,75 @@ public:
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
 
+protected:
+    Number(ObjectType type, int64_t value);
+
 private:
     int64_t value_;
 };
 
 class FakeNumber : public Number {
 public:
-    using Number::Number;
+    FakeNumber(int64_t value);
+    virtual Object* Eval(Scope* scope) override;
 };
 
+// Integers that fit in 63 bits are not allocated. The pointer holds
+// value << 1 | 1, which no object address has, see Heap::GetNumber. Is<Number>
+// holds for them but As<Number> gives nullptr, so read numbers with
+// GetInteger and evaluate and print values with EvalObject and
+// ObjectToString.
+constexpr int64_t kMinFixnum = INT64_MIN >> 1;
+constexpr int64_t kMaxFixnum = INT64_MAX >> 1;
+
+inline bool IsFixnum(const Object* obj) {
+    return reinterpret_cast<uintptr_t>(obj) & 1;
+}
+
+inline Object* MakeFixnum(int64_t value) {
+    return reinterpret_cast<Object*>(static_cast<uintptr_t>(value) << 1 | 1);
+}
+
+// The value of a fixnum or of a Number.
+inline int64_t GetInteger(Object* obj) {
+    if (IsFixnum(obj)) {
+        return static_cast<int64_t>(reinterpret_cast<uintptr_t>(obj)) >> 1;
+    }
+    return static_cast<Number*>(obj)->GetValue();
+}
+
+inline Object* EvalObject(Object* obj, Scope* scope) {
+    return IsFixnum(obj) ? obj : obj->Eval(scope);
+}
+
+std::string ObjectToString(Object* obj);
+
 class Symbol : public Object {
 public:
     Symbol(const std::string& str);
+    Symbol(SymbolId id);
+    SymbolId GetId() const;
     const std::string& GetName() const;
     void AddArgc(int argc);
     void SetArgc(int argc);
     int GetArgc() const;
+    void SetAddress(LexicalAddress address);
+    const LexicalAddress& GetAddress() const;
 
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
 
 protected:
-    std::string name_;
+    Symbol(ObjectType type, SymbolId id);
+
+    SymbolId id_;
     int argc_ = 0;
+    LexicalAddress address_;
 };
 
 class LambdaSymbol : public Symbol {
 public:
-    using Symbol::Symbol;
+    LambdaSymbol(const std::string& str);
     void SetVarc(int varc);
     int GetVarc() const;
 
@@ -92,6 +198,42 @@ private:
     bool value_;
 };
 
+class Function;
+class LambdaInvoker;
+
+// A call to a lambda left for the caller to make, so that calls in tail
+// position do not grow the native stack.
+struct TailCall {
+    LambdaInvoker* invoker = nullptr;
+    std::vector<Object*> args;
+};
+
+// What a call made at a cell of code keeps between runs, see CallCell.
+struct CallSite {
+    // A builtin the head named in the last call made here. It stays the
+    // callee while the builtin version is the same. Other global callees
+    // are read from the slot the head symbol recorded, so rebinding one
+    // global does not affect the calls of another.
+    struct Cache {
+        uint64_t version = 0;
+        Object* callee = nullptr;
+    };
+
+    // Where each argument of the call begins in the chain. The elements are
+    // reachable through the chain, so the collector does not trace them.
+    std::vector<Object*> args;
+    // Compiled on the first Eval, and again after a Fold.
+    std::unique_ptr<Code> code;
+    Cache cache;
+    Object* folded = nullptr;
+    uint64_t folded_version = 0;
+    bool folded_branch = false;
+    // The lambda a folded call was made to, if it was not a builtin.
+    Object* folded_callee = nullptr;
+};
+
+// A link of a chain. Quoted data is made of plain cells, the parser reads
+// code into CallCells.
 class Cell : public Object {
 public:
     Cell(Object* first);
@@ -102,16 +244,70 @@ public:
     void SetFirst(Object* ptr);
     void SetSecond(Object* ptr);
 
+    // The arguments of the call starting at this cell, empty for data.
+    const std::vector<Object*>& GetArguments() const;
+
+    // Data is only evaluated where quote was rebound, it is compiled anew
+    // every time.
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
 
-    virtual void Mark() override;
+    virtual void MarkChildren(Heap* heap) override;
+
+protected:
+    Cell(ObjectType type, Object* first);
 
 private:
+    friend class Code;
+
+    // The state of the call made here, or nullptr if there is none yet.
+    CallSite* FindSite() const;
+
+    Object* EvalHead(Scope* scope);
+
+    // Makes the calls the code of a cell leaves to native code, given the
+    // value of the head. A call to a lambda is stored in *tail, and the
+    // branch of if to go on with in *branch, instead of being made.
+    Object* FinishCall(Object* func, Scope* scope, TailCall* tail, Object** branch);
+
+    // Errors are rethrown as the RuntimeError of the kind the function
+    // wants, after the arguments before them have been collected.
+    std::vector<Object*> CollectArgs(Function* func, int argc, Scope* scope);
+    void CollectArgs(Function* func, int argc, Scope* scope, Object** args);
+
     Object* first_;
     Object* second_;
 };
 
+// A cell of code. Its CallSite is allocated by the parser for cells that
+// start a call and by the compiler for the others it compiles, so cells
+// never run on their own only add one pointer to a data cell.
+class CallCell : public Cell {
+public:
+    CallCell(Object* first);
+
+    // Filled in by the parser, see CallSite::args.
+    void SetArguments(std::vector<Object*> args);
+
+    virtual Object* Eval(Scope* scope) override;
+    virtual void MarkChildren(Heap* heap) override;
+
+    // Makes evaluating the call give value right away or, if branch is set,
+    // go on with value the way if goes on with the branch it takes. Holds
+    // while the builtin version stays the same and, if callee is set, while
+    // the head still gives callee, see Optimize.
+    void Fold(Object* value, bool branch, Object* callee = nullptr);
+
+private:
+    friend class Cell;
+    friend class Code;
+
+    CallSite* GetSite();
+    const Code& GetCode();
+
+    std::unique_ptr<CallSite> site_;
+};
+
 class LambdaCell : public Object {
 public:
     LambdaCell(Object* first);
@@ -119,101 +315,118 @@ public:
     void SetFirst(Object* ptr);
     void SetSecond(Object* ptr);
 
+    Object* GetFirst() const;
+    Object* GetSecond() const;
+
+    // The parameters followed by the body expressions, see Cell.
+    const std::vector<Object*>& GetArguments() const;
+    void SetArguments(std::vector<Object*> args);
+
+    // What closures made from this lambda run, collected from the arguments
+    // when the first one is made and shared by all of them.
+    const std::vector<Object*>& GetBody() const;
+    // The body compiled, on the first call.
+    const Code& GetCode();
+
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
-    virtual void Mark() override;
+    virtual void MarkChildren(Heap* heap) override;
 
 private:
     Object* first_;
     Object* second_;
+    std::vector<Object*> args_;
+    std::vector<Object*> body_;
+    std::unique_ptr<Code> code_;
 };
 
+// Builtins are stateless and shared, see FindBuiltin. The number of
+// arguments comes from the call site.
 class Function : public Object {
 public:
-    Function(int argc);
+    Function(ObjectType type = ObjectType::kFunction);
+
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
 
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) = 0;
-    virtual std::vector<Object*> CollectArgs(Object* root, Scope* scope) = 0;
+    virtual ArgumentKind GetArgumentKind() = 0;
 
-protected:
-    int argc_;
+    // Calls with one or two evaluated arguments go through these, so the
+    // arguments need no vector. By default they forward to Apply.
+    virtual Object* ApplyUnary(Object* arg, Scope* scope);
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope);
 };
 
 class FunctionEval : public Function {
 public:
     using Function::Function;
-    virtual std::vector<Object*> CollectArgs(Object* root, Scope* scope) override;
+    virtual ArgumentKind GetArgumentKind() override;
 };
 
 class FunctionNoEval : public Function {
 public:
     using Function::Function;
-    virtual std::vector<Object*> CollectArgs(Object* root, Scope* scope) override;
-};
-
-class LambdaFunction : public FunctionNoEval {
-public:
-    LambdaFunction(int argc, int argv, Scope* scope);
-    virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
-    virtual void Mark() override;
-
-private:
-    int argv_;
-    Scope* scope_;
+    virtual ArgumentKind GetArgumentKind() override;
 };
 
+// A closure. It never changes once made, so references to it are shared.
 class LambdaInvoker : public FunctionEval {
 public:
-    LambdaInvoker(int argc, int argv, Scope* scope, std::vector<Object*>& state);
+    LambdaInvoker(int argc, LambdaCell* lambda, Scope* scope);
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
-    virtual void Mark() override;
+    virtual void MarkChildren(Heap* heap) override;
 
     int GetArgc();
+    LambdaCell* GetLambda();
 
 private:
-    int argv_;
+    friend class Code;
+
+    // The frame of a call, with the parameters bound to args, of which
+    // there are argc_.
+    Scope* Bind(Object** args);
+
+    int argc_;
+    LambdaCell* lambda_;
     Scope* scope_;
-    std::vector<Object*> state_;
 };
 
 class DefineVar : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class SetVar : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class And : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class Or : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class If : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
+    If();
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+
+    // Evaluates the condition and returns the expression of the branch
+    // taken, or nullptr if there is none.
+    Object* SelectBranch(std::vector<Object*>& args, Scope* scope);
 };
 
 class QuoteFunction : public FunctionNoEval {
 public:
-    using FunctionNoEval::FunctionNoEval;
-    virtual std::vector<Object*> CollectArgs(Object* root, Scope* scope) override;
+    virtual ArgumentKind GetArgumentKind() override;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
@@ -227,7 +440,7 @@ public:
 
     virtual Object* Eval(Scope* scope) override;
     virtual std::string ToString() override;
-    virtual void Mark() override;
+    virtual void MarkChildren(Heap* heap) override;
 
 private:
     bool IsObject(size_t i);
@@ -236,177 +449,233 @@ private:
 
 class IsNumber : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class IsPair : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class IsList : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class IsSymbol : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class MakeList : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class ListTail : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class ListRef : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class IsNull : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class IsBoolean : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class Not : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyUnary(Object* arg, Scope* scope) override;
 };
 
 class MakePair : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class Head : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class SetHead : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class Tail : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class SetTail : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
 class Equal : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Less : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Greater : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class LessEqual : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class GreaterEqual : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Sum : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Difference : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Product : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Division : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Max : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Min : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyBinary(Object* lhs, Object* rhs, Scope* scope) override;
 };
 
 class Abs : public FunctionEval {
 public:
-    using FunctionEval::FunctionEval;
+    virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+    virtual Object* ApplyUnary(Object* arg, Scope* scope) override;
+};
+
+class GcStats : public FunctionEval {
+public:
+    virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
+};
+
+class HeapHistogram : public FunctionEval {
+public:
     virtual Object* Apply(std::vector<Object*>& args, Scope* scope) override;
 };
 
+// Shared instance of the builtin called id, or nullptr.
+Function* FindBuiltin(SymbolId id);
+
+// What a builtin that does not evaluate its arguments gets for the argument
+// arg of a call site, or nullptr if it can not get one.
+Object* Unevaluated(Object* arg);
+
 ///////////////////////////////////////////////////////////////////////////////
 
 // Runtime type checking and convertion.
 // This can be helpful: https://en.cppreference.com/w/cpp/memory/shared_ptr/pointer_cast
 
+// The tags of T and its subclasses, for the classes that have a tag.
 template <class T>
-T* As(Object* obj) {
-    return dynamic_cast<T*>(obj);
-}
+struct TypeRange {};
+
+template <ObjectType First, ObjectType Last = First>
+struct TagRange {
+    static constexpr ObjectType kFirst = First;
+    static constexpr ObjectType kLast = Last;
+};
+
+template <>
+struct TypeRange<Scope> : TagRange<ObjectType::kScope> {};
+template <>
+struct TypeRange<Number> : TagRange<ObjectType::kNumber, ObjectType::kFakeNumber> {};
+template <>
+struct TypeRange<FakeNumber> : TagRange<ObjectType::kFakeNumber> {};
+template <>
+struct TypeRange<Symbol> : TagRange<ObjectType::kSymbol, ObjectType::kLambdaSymbol> {};
+template <>
+struct TypeRange<LambdaSymbol> : TagRange<ObjectType::kLambdaSymbol> {};
+template <>
+struct TypeRange<Boolean> : TagRange<ObjectType::kBoolean> {};
+template <>
+struct TypeRange<Cell> : TagRange<ObjectType::kCell, ObjectType::kCallCell> {};
+template <>
+struct TypeRange<CallCell> : TagRange<ObjectType::kCallCell> {};
+template <>
+struct TypeRange<LambdaCell> : TagRange<ObjectType::kLambdaCell> {};
+template <>
+struct TypeRange<List> : TagRange<ObjectType::kList> {};
+template <>
+struct TypeRange<Function> : TagRange<ObjectType::kFunction, ObjectType::kIf> {};
+template <>
+struct TypeRange<LambdaInvoker> : TagRange<ObjectType::kLambdaInvoker> {};
+template <>
+struct TypeRange<If> : TagRange<ObjectType::kIf> {};
 
 template <class T>
 bool Is(Object* obj) {
-    return dynamic_cast<T*>(obj) != nullptr;
+    if constexpr (requires { TypeRange<T>::kFirst; }) {
+        if (IsFixnum(obj)) {
+            return TypeRange<T>::kFirst <= ObjectType::kNumber &&
+                   ObjectType::kNumber <= TypeRange<T>::kLast;
+        }
+        return obj != nullptr && obj->GetType() >= TypeRange<T>::kFirst &&
+               obj->GetType() <= TypeRange<T>::kLast;
+    } else {
+        return !IsFixnum(obj) && dynamic_cast<T*>(obj) != nullptr;
+    }
+}
+
+template <class T>
+T* As(Object* obj) {
+    if (IsFixnum(obj)) {
+        return nullptr;
+    }
+    if constexpr (requires { TypeRange<T>::kFirst; }) {
+        return Is<T>(obj) ? static_cast<T*>(obj) : nullptr;
+    } else {
+        return dynamic_cast<T*>(obj);
+    }
 }
@@ -0,0 +1,223 @@
+#include "optimizer.h"
+
+#include <algorithm>
+
+#include "heap.h"
+
+namespace {
+// Constant expressions always give the same value, pure ones only depend on
+// the parameters of the lambdas around them. Neither has side effects.
+enum class Purity { kImpure, kPure, kConstant };
+
+// Builtins whose result only depends on their arguments. Division is left
+// out, dividing by zero traps instead of throwing.
+bool IsPureBuiltin(SymbolId id) {
+    static const auto kPure = [] {
+        std::vector<SymbolId> ids;
+        for (auto name : {"=", "<", ">", "<=", ">=", "+", "-", "*", "max", "min",
+                          "abs", "not", "and", "or", "if", "number?",
+                          "boolean?"}) {
+            ids.push_back(SymbolTable::GetTable().Intern(name));
+        }
+        return ids;
+    }();
+    return std::find(kPure.begin(), kPure.end(), id) != kPure.end();
+}
+
+class Optimizer {
+public:
+    explicit Optimizer(Scope* scope)
+        : scope_(scope),
+          quote_(SymbolTable::GetTable().Intern("quote")),
+          if_(SymbolTable::GetTable().Intern("if")) {
+    }
+
+    void Run(Object* root) {
+        // A lambda is only applied where it is made at the head of an
+        // expression, elsewhere the lambda itself is the value.
+        auto cell = As<CallCell>(root);
+        if (cell != nullptr && Is<LambdaCell>(cell->GetFirst())) {
+            auto args = VisitArguments(cell->GetArguments());
+            auto body = VisitLambda(As<LambdaCell>(cell->GetFirst()));
+            if (args == Purity::kConstant && body != Purity::kImpure) {
+                FoldValue(cell);
+            }
+            return;
+        }
+        Visit(root);
+    }
+
+private:
+    Purity Visit(Object* obj) {
+        if (Is<LambdaCell>(obj)) {
+            VisitLambda(As<LambdaCell>(obj));
+            return Purity::kImpure;
+        } else if (!Is<CallCell>(obj)) {
+            return Purity::kImpure;
+        }
+
+        auto cell = As<CallCell>(obj);
+        auto first = cell->GetFirst();
+        if (Is<Symbol>(first)) {
+            return VisitCall(cell, As<Symbol>(first));
+        } else if (Is<LambdaCell>(first)) {
+            VisitLambda(As<LambdaCell>(first));
+            VisitArguments(cell->GetArguments());
+            return Purity::kImpure;
+        } else if (Is<Boolean>(first) ||
+                   (Is<Number>(first) && !Is<FakeNumber>(first))) {
+            return Purity::kConstant;
+        }
+        return Purity::kImpure;
+    }
+
+    Purity VisitCall(CallCell* cell, Symbol* head) {
+        SymbolId id = head->GetId();
+        const auto& args = cell->GetArguments();
+
+        if (std::find(bound_.begin(), bound_.end(), id) != bound_.end()) {
+            VisitArguments(args);
+            return head->GetArgc() == 0 ? Purity::kPure : Purity::kImpure;
+        }
+
+        // Only global names are guarded by the builtin version, a define in
+        // a lambda body does not change it.
+        bool global = head->GetAddress().kind == LexicalAddress::Kind::kGlobal;
+        if (!IsPureBuiltin(id) || scope_->Get(id) != nullptr || !global) {
+            // Quoted data is not code.
+            if (id == quote_) {
+                return Purity::kImpure;
+            }
+            if (VisitArguments(args) == Purity::kConstant && global &&
+                FoldLambdaCall(cell, id)) {
+                return Purity::kConstant;
+            }
+            return Purity::kImpure;
+        }
+
+        auto purity = Purity::kConstant;
+        auto condition = Purity::kImpure;
+        for (size_t i = 0; i < args.size(); ++i) {
+            auto arg = Visit(args[i]);
+            if (i == 0) {
+                condition = arg;
+            }
+            purity = std::min(purity, arg);
+        }
+
+        if (purity == Purity::kConstant) {
+            return FoldValue(cell) ? Purity::kConstant : Purity::kImpure;
+        }
+        if (id == if_ && args.size() >= 2 && args.size() <= 3 &&
+            condition == Purity::kConstant) {
+            FoldBranch(cell);
+        }
+        return purity;
+    }
+
+    Purity VisitArguments(const std::vector<Object*>& args) {
+        auto purity = Purity::kConstant;
+        for (auto arg : args) {
+            purity = std::min(purity, Visit(arg));
+        }
+        return purity;
+    }
+
+    // Returns the purity of the body with the parameters bound.
+    Purity VisitLambda(LambdaCell* lambda) {
+        const auto& args = lambda->GetArguments();
+        size_t params = std::min<size_t>(
+            As<LambdaSymbol>(lambda->GetFirst())->GetVarc(), args.size());
+
+        size_t outer = bound_.size();
+        for (size_t i = 0; i < params; ++i) {
+            if (Is<Cell>(args[i]) && Is<Symbol>(As<Cell>(args[i])->GetFirst())) {
+                bound_.push_back(
+                    As<Symbol>(As<Cell>(args[i])->GetFirst())->GetId());
+            }
+        }
+
+        auto purity = params < args.size() ? Purity::kConstant : Purity::kImpure;
+        for (size_t i = params; i < args.size(); ++i) {
+            purity = std::min(purity, Visit(args[i]));
+        }
+        bound_.resize(outer);
+        return purity;
+    }
+
+    // A call of a global lambda with constant arguments folds if the body
+    // only uses the parameters and pure builtins. The body is not inlined
+    // otherwise. Lambdas that call lambdas, themselves included, are left
+    // alone, so folding never recurses.
+    bool FoldLambdaCall(CallCell* cell, SymbolId id) {
+        auto callee = As<LambdaInvoker>(scope_->Get(id));
+        if (callee == nullptr || in_callee_) {
+            return false;
+        }
+
+        // The folded call is made outside the frames around it.
+        std::vector<SymbolId> outer;
+        outer.swap(bound_);
+        in_callee_ = true;
+        auto body = VisitLambda(callee->GetLambda());
+        in_callee_ = false;
+        bound_.swap(outer);
+        return body != Purity::kImpure && FoldValue(cell, callee);
+    }
+
+    bool FoldValue(CallCell* cell, Object* callee = nullptr) {
+        uint64_t version = Scope::GetBuiltinVersion();
+        Object* value;
+        try {
+            value = cell->Eval(scope_);
+        } catch (...) {
+            return false;
+        }
+
+        if (version != Scope::GetBuiltinVersion()) {
+            return false;
+        }
+        cell->Fold(value, false, callee);
+        return true;
+    }
+
+    void FoldBranch(CallCell* cell) {
+        const auto& args = cell->GetArguments();
+        uint64_t version = Scope::GetBuiltinVersion();
+        Object* condition;
+        try {
+            condition = EvalObject(Unevaluated(args[0]), scope_);
+        } catch (...) {
+            return;
+        }
+
+        if (version != Scope::GetBuiltinVersion()) {
+            return;
+        }
+        if (condition != Heap::GetHeap().GetBoolean(false)) {
+            if (auto branch = Unevaluated(args[1])) {
+                cell->Fold(branch, true);
+            }
+        } else if (args.size() == 3) {
+            if (auto branch = Unevaluated(args[2])) {
+                cell->Fold(branch, true);
+            }
+        } else {
+            cell->Fold(Heap::GetHeap().GetEmptyList(), false);
+        }
+    }
+
+private:
+    Scope* scope_;
+    SymbolId quote_;
+    SymbolId if_;
+    // Parameters of the lambdas around the expression being visited.
+    std::vector<SymbolId> bound_;
+    // Set while the body of a lambda a call may fold to is visited.
+    bool in_callee_ = false;
+};
+}  // namespace
+
+void Optimize(Object* root, Scope* scope) {
+    Optimizer(scope).Run(root);
+}
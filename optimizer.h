@@ -0,0 +1,15 @@
+#pragma once
+
+#include "object.h"
+
+// Simplifies a parsed expression before it runs in scope. Calls of pure
+// builtins whose arguments are all constant are evaluated once and fold to
+// their result, including lambdas applied at the head of the expression.
+// Calls of global lambdas with constant arguments fold the same way, in
+// loops and other lambdas too, if the lambda only uses its parameters and
+// pure builtins; they hold while the name still gives that lambda. An if
+// whose condition is constant folds to the branch it takes. Nothing is
+// inlined: every other call of a lambda is made when the code runs. Folds
+// stop applying as soon as a builtin name gets bound in the global frame,
+// see CallCell::Fold.
+void Optimize(Object* root, Scope* scope);
@@ -2,30 +2,97 @@
 #include "heap.h"
 
 namespace {
-Object* Add(Object* root, Object* next) {
-    if (root == nullptr) {
-        return next;
-    } else if (!Is<Cell>(root)) {
-        root = Heap::GetHeap().Allocate<Cell>(root);
-        As<Cell>(root)->SetSecond(next);
-        return root;
-    } else if (!(As<Cell>(root)->GetSecond())) {
-        As<Cell>(root)->SetSecond(next);
-        return root;
-    } else {
-        As<Cell>(root)->SetSecond(Add(As<Cell>(root)->GetSecond(), next));
-        return root;
+// Names of the forms read specially.
+const SymbolId kLambda = SymbolTable::GetTable().Intern("lambda");
+const SymbolId kDefine = SymbolTable::GetTable().Intern("define");
+const SymbolId kSet = SymbolTable::GetTable().Intern("set!");
+const SymbolId kQuote = SymbolTable::GetTable().Intern("quote");
+
+// Quoted data is read into plain cells, code into cells that can keep the
+// state of a call.
+Cell* MakeCell(Object* first, bool data) {
+    if (data) {
+        return As<Cell>(Heap::GetHeap().Allocate<Cell>(first));
     }
+    return As<Cell>(Heap::GetHeap().Allocate<CallCell>(first));
 }
 
+// A chain built front to back. It keeps its last cell, so appending does
+// not walk the elements added before. An element that is not a cell gets
+// wrapped in one once something follows it.
+class Chain {
+public:
+    explicit Chain(bool data) : data_(data) {
+    }
+    explicit Chain(Object* root) {
+        Add(root);
+    }
+
+    Object* GetRoot() const {
+        return root_;
+    }
+
+    void Add(Object* next) {
+        if (next == nullptr) {
+            return;
+        } else if (root_ == nullptr) {
+            root_ = next;
+        } else {
+            if (last_ == nullptr) {
+                last_ = MakeCell(root_, data_);
+                root_ = last_;
+            }
+            // An element may be a chain of its own, its end is only looked
+            // for once something follows it.
+            while (Is<Cell>(last_->GetSecond())) {
+                last_ = As<Cell>(last_->GetSecond());
+            }
+            if (last_->GetSecond() != nullptr) {
+                auto cell = MakeCell(last_->GetSecond(), data_);
+                last_->SetSecond(cell);
+                last_ = cell;
+            }
+            last_->SetSecond(next);
+        }
+
+        if (Is<Cell>(next)) {
+            last_ = As<Cell>(next);
+        }
+    }
+
+    void PushFront(Cell* cell) {
+        cell->SetSecond(root_);
+        root_ = cell;
+        if (last_ == nullptr) {
+            last_ = cell;
+        }
+    }
+
+private:
+    Object* root_ = nullptr;
+    // A cell the end of the chain is reached from, null while the chain is
+    // not a cell.
+    Cell* last_ = nullptr;
+    bool data_ = false;
+};
+
 int Size(Object* root) {
-    if (root == nullptr) {
-        return 0;
-    } else if (!Is<Cell>(root)) {
-        return 1;
-    } else {
-        return 1 + Size(As<Cell>(root)->GetSecond());
+    int size = 0;
+    while (root != nullptr) {
+        ++size;
+        root = Is<Cell>(root) ? As<Cell>(root)->GetSecond() : nullptr;
     }
+    return size;
+}
+
+// The objects of a chain, one per element.
+std::vector<Object*> Elements(Object* root) {
+    std::vector<Object*> elements;
+    while (root != nullptr) {
+        elements.push_back(root);
+        root = Is<Cell>(root) ? As<Cell>(root)->GetSecond() : nullptr;
+    }
+    return elements;
 }
 }  // namespace
 
@@ -43,22 +110,22 @@ Object* Read(Tokenizer* tokenizer, bool consider_all) {
         throw SyntaxError("Closed bracket without corresponding open");
     } else if (IsSameToken<BooleanToken>(&token)) {
         tokenizer->Next();
-        return Heap::GetHeap().Allocate<Boolean>(
-            std::get<BooleanToken>(token).value);
+        return Heap::GetHeap().GetBoolean(std::get<BooleanToken>(token).value);
     } else if (IsSameToken<QuoteToken>(&token)) {
         if (consider_all) {
             tokenizer->Next();
-            return Heap::GetHeap().Allocate<Symbol>("quote");
+            return Heap::GetHeap().Allocate<Symbol>(kQuote);
         } else {
-            auto res = Heap::GetHeap().Allocate<Cell>(
-                Heap::GetHeap().Allocate<Symbol>("quote"));
+            auto res = Heap::GetHeap().Allocate<CallCell>(
+                Heap::GetHeap().Allocate<Symbol>(kQuote));
             tokenizer->Next();
             auto next = Read(tokenizer, true);
             if (!Is<Cell>(next)) {
-                next = Heap::GetHeap().Allocate<Cell>(next);
+                next = MakeCell(next, true);
             }
-            As<Symbol>(As<Cell>(res)->GetFirst())->AddArgc(Size(next));
-            As<Cell>(res)->SetSecond(next);
+            As<Symbol>(As<CallCell>(res)->GetFirst())->AddArgc(Size(next));
+            As<CallCell>(res)->SetArguments(Elements(next));
+            As<CallCell>(res)->SetSecond(next);
             return res;
         }
     } else if (IsSameToken<DotToken>(&token)) {
@@ -66,10 +133,10 @@ Object* Read(Tokenizer* tokenizer, bool consider_all) {
     } else if (IsSameToken<SymbolToken>(&token)) {
         tokenizer->Next();
         return Heap::GetHeap().Allocate<Symbol>(
-            std::get<SymbolToken>(token).name);
+            std::get<SymbolToken>(token).id);
     } else if (IsSameToken<ConstantToken>(&token)) {
         tokenizer->Next();
-        return Heap::GetHeap().Allocate<Number>(
+        return Heap::GetHeap().GetNumber(
             std::get<ConstantToken>(token).value);
     }
 
@@ -78,11 +145,10 @@ Object* Read(Tokenizer* tokenizer, bool consider_all) {
 
 namespace {
 void Null(Object* root) {
-    if (root == nullptr) {
-        return;
-    } else {
+    while (root != nullptr) {
         As<Symbol>(As<Cell>(root)->GetFirst())->SetArgc(0);
-        Null(As<Cell>(root)->GetSecond());
+        As<CallCell>(root)->SetArguments({});
+        root = As<Cell>(root)->GetSecond();
     }
 }
 }  // namespace
@@ -92,8 +158,10 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
         throw SyntaxError("Open bracket without corresponding closed");
     }
 
-    Object* root = nullptr;
+    Chain chain(consider_all);
     int argc = 0;
+    // The elements after the first are the arguments of the call.
+    std::vector<Object*> elements;
 
     Token token = tokenizer->GetToken();
     if (IsSameToken<DotToken>(&token)) {
@@ -104,7 +172,7 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
         if (tokenizer->IsEnd()) {
             throw SyntaxError("No closed bracket at the end");
         }
-        if (token == Token{SymbolToken{"lambda"}}) {
+        if (token == Token{SymbolToken{kLambda}}) {
             tokenizer->Next();
             auto lambda_info = Heap::GetHeap().Allocate<LambdaSymbol>("lambda");
             auto lambda = Heap::GetHeap().Allocate<LambdaCell>(nullptr);
@@ -124,6 +192,8 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
             }
 
             Null(args);
+            auto lambda_args = Elements(args);
+            Chain body(args);
 
             while (tokenizer->GetToken() != Token(BracketToken::CLOSE)) {
                 if (tokenizer->IsEnd()) {
@@ -133,10 +203,11 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
                 auto expr = Read(tokenizer);
 
                 if (!Is<Cell>(expr)) {
-                    expr = Heap::GetHeap().Allocate<Cell>(expr);
+                    expr = Heap::GetHeap().Allocate<CallCell>(expr);
                 }
 
-                args = Add(args, expr);
+                body.Add(expr);
+                lambda_args.push_back(expr);
                 sz += 1;
             }
 
@@ -144,13 +215,15 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
 
             As<LambdaSymbol>(lambda_info)->AddArgc(sz);
             As<LambdaCell>(lambda)->SetFirst(lambda_info);
-            As<LambdaCell>(lambda)->SetSecond(args);
+            As<LambdaCell>(lambda)->SetSecond(body.GetRoot());
+            As<LambdaCell>(lambda)->SetArguments(std::move(lambda_args));
 
-            return Heap::GetHeap().Allocate<Cell>(lambda);
-        } else if (token == Token{SymbolToken{"define"}}) {
-            auto define = Heap::GetHeap().Allocate<Cell>(
+            return Heap::GetHeap().Allocate<CallCell>(lambda);
+        } else if (token == Token{SymbolToken{kDefine}}) {
+            auto define = Heap::GetHeap().Allocate<CallCell>(
                 Heap::GetHeap().Allocate<Symbol>("_define-var"));
-            root = Add(root, define);
+            chain.Add(define);
+            elements.push_back(define);
 
             tokenizer->Next();
             if (tokenizer->GetToken() == Token(BracketToken::CLOSE) ||
@@ -159,17 +232,20 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
             }
 
             if (tokenizer->GetToken() == Token(BracketToken::OPEN)) {
-                As<Symbol>(As<Cell>(root)->GetFirst())->AddArgc(2);
+                As<Symbol>(As<Cell>(chain.GetRoot())->GetFirst())->AddArgc(2);
                 auto lambda_info =
                     Heap::GetHeap().Allocate<LambdaSymbol>("lambda");
 
                 auto args = Read(tokenizer);
                 Null(args);
-                auto name =
-                    Heap::GetHeap().Allocate<Cell>(As<Cell>(args)->GetFirst());
+                auto name = Heap::GetHeap().Allocate<CallCell>(
+                    As<Cell>(args)->GetFirst());
                 args = As<Cell>(args)->GetSecond();
-                root = Add(root, name);
+                chain.Add(name);
+                elements.push_back(name);
                 int sz = Size(args);
+                auto lambda_args = Elements(args);
+                Chain body(args);
                 As<LambdaSymbol>(lambda_info)->SetVarc(sz);
 
                 if (tokenizer->GetToken() == Token(BracketToken::CLOSE) ||
@@ -185,10 +261,11 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
                     auto expr = Read(tokenizer);
 
                     if (!Is<Cell>(expr)) {
-                        expr = Heap::GetHeap().Allocate<Cell>(expr);
+                        expr = Heap::GetHeap().Allocate<CallCell>(expr);
                     }
 
-                    args = Add(args, expr);
+                    body.Add(expr);
+                    lambda_args.push_back(expr);
                     sz += 1;
                 }
 
@@ -198,9 +275,15 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
                 auto lambda = Heap::GetHeap().Allocate<LambdaCell>(nullptr);
 
                 As<LambdaCell>(lambda)->SetFirst(lambda_info);
-                As<LambdaCell>(lambda)->SetSecond(args);
+                As<LambdaCell>(lambda)->SetSecond(body.GetRoot());
+                As<LambdaCell>(lambda)->SetArguments(std::move(lambda_args));
 
-                return Add(root, lambda);
+                chain.Add(lambda);
+                elements.push_back(lambda);
+                if (auto root = As<CallCell>(chain.GetRoot())) {
+                    root->SetArguments({elements.begin() + 1, elements.end()});
+                }
+                return chain.GetRoot();
             }
 
             auto symbol = Read(tokenizer);
@@ -209,8 +292,9 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
                     "define does not expect expression as variable");
             }
 
-            symbol = Heap::GetHeap().Allocate<Cell>(symbol);
-            root = Add(root, symbol);
+            symbol = Heap::GetHeap().Allocate<CallCell>(symbol);
+            chain.Add(symbol);
+            elements.push_back(symbol);
 
             if (tokenizer->GetToken() == Token(BracketToken::CLOSE) ||
                 tokenizer->IsEnd()) {
@@ -219,22 +303,24 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
 
             auto expr = Read(tokenizer);
             if (!Is<Cell>(expr)) {
-                expr = Heap::GetHeap().Allocate<Cell>(expr);
+                expr = Heap::GetHeap().Allocate<CallCell>(expr);
             } else if (Is<Cell>(expr) &&
                        Is<LambdaCell>(As<Cell>(expr)->GetFirst())) {
                 expr = As<Cell>(expr)->GetFirst();
             }
-            root = Add(root, expr);
+            chain.Add(expr);
+            elements.push_back(expr);
 
             if (tokenizer->GetToken() != Token(BracketToken::CLOSE)) {
                 throw SyntaxError("define expects 2 arguments");
             }
 
             argc += 3;
-        } else if (token == Token{SymbolToken{"set!"}}) {
-            auto define = Heap::GetHeap().Allocate<Cell>(
+        } else if (token == Token{SymbolToken{kSet}}) {
+            auto define = Heap::GetHeap().Allocate<CallCell>(
                 Heap::GetHeap().Allocate<Symbol>("_set-var"));
-            root = Add(root, define);
+            chain.Add(define);
+            elements.push_back(define);
 
             tokenizer->Next();
             if (tokenizer->GetToken() == Token(BracketToken::CLOSE) ||
@@ -248,8 +334,9 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
                     "set! does not expect expression as variable");
             }
 
-            symbol = Heap::GetHeap().Allocate<Cell>(symbol);
-            root = Add(root, symbol);
+            symbol = Heap::GetHeap().Allocate<CallCell>(symbol);
+            chain.Add(symbol);
+            elements.push_back(symbol);
 
             if (tokenizer->GetToken() == Token(BracketToken::CLOSE) ||
                 tokenizer->IsEnd()) {
@@ -258,9 +345,10 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
 
             auto expr = Read(tokenizer);
             if (!Is<Cell>(expr)) {
-                expr = Heap::GetHeap().Allocate<Cell>(expr);
+                expr = Heap::GetHeap().Allocate<CallCell>(expr);
             }
-            root = Add(root, expr);
+            chain.Add(expr);
+            elements.push_back(expr);
 
             if (tokenizer->GetToken() != Token(BracketToken::CLOSE)) {
                 throw SyntaxError("set! expects 2 arguments");
@@ -277,15 +365,16 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
             }
             if (Is<Number>(expr)) {
                 expr = Heap::GetHeap().Allocate<FakeNumber>(
-                    As<Number>(expr)->GetValue());
+                    GetInteger(expr));
             }
 
-            root = Add(root, expr);
+            chain.Add(expr);
+            elements.push_back(expr);
             argc++;
         } else if (IsSameToken<QuoteToken>(&token) ||
-                   token == Token{SymbolToken{"quote"}}) {
+                   token == Token{SymbolToken{kQuote}}) {
             auto expr = Read(tokenizer, true);
-            expr = Heap::GetHeap().Allocate<Cell>(expr);
+            expr = Heap::GetHeap().Allocate<CallCell>(expr);
             argc++;
 
             token = tokenizer->GetToken();
@@ -295,18 +384,21 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
 
             auto next = Read(tokenizer, true);
             if (!Is<Cell>(next)) {
-                next = Heap::GetHeap().Allocate<Cell>(next);
+                next = MakeCell(next, true);
             }
-            As<Symbol>(As<Cell>(expr)->GetFirst())->AddArgc(Size(next));
-            root = Add(root, expr);
-            root = Add(root, next);
+            As<Symbol>(As<CallCell>(expr)->GetFirst())->AddArgc(Size(next));
+            As<CallCell>(expr)->SetArguments(Elements(next));
+            chain.Add(expr);
+            chain.Add(next);
+            elements.push_back(expr);
         } else {
             auto expr = Read(tokenizer, consider_all);
 
             if (!Is<Cell>(expr)) {
-                expr = Heap::GetHeap().Allocate<Cell>(expr);
+                expr = MakeCell(expr, consider_all);
             }
-            root = Add(root, expr);
+            chain.Add(expr);
+            elements.push_back(expr);
             argc++;
         }
 
@@ -315,20 +407,24 @@ Object* ReadList(Tokenizer* tokenizer, bool consider_all) {
 
     tokenizer->Next();
 
+    auto root = chain.GetRoot();
     if (Is<Cell>(root) && Is<Symbol>(As<Cell>(root)->GetFirst())) {
         argc--;
     }
 
     if (consider_all) {
-        auto temp = root;
-        root = Heap::GetHeap().Allocate<Cell>(
-            Heap::GetHeap().Allocate<Symbol>("("));
-        As<Cell>(root)->SetSecond(temp);
-        root = Add(root, Heap::GetHeap().Allocate<Cell>(
-                             Heap::GetHeap().Allocate<Symbol>(")")));
+        chain.PushFront(MakeCell(Heap::GetHeap().GetOpenBracket(), true));
+        chain.Add(MakeCell(Heap::GetHeap().GetCloseBracket(), true));
+        root = chain.GetRoot();
         argc += 2;
-    } else if (Is<Cell>(root) && Is<Symbol>(As<Cell>(root)->GetFirst())) {
-        As<Symbol>(As<Cell>(root)->GetFirst())->AddArgc(argc);
+    } else if (Is<CallCell>(root)) {
+        if (Is<Symbol>(As<CallCell>(root)->GetFirst())) {
+            As<Symbol>(As<CallCell>(root)->GetFirst())->AddArgc(argc);
+        }
+        // A quote at the head already has the quoted elements.
+        auto args = As<CallCell>(root)->GetArguments();
+        args.insert(args.end(), elements.begin() + 1, elements.end());
+        As<CallCell>(root)->SetArguments(std::move(args));
     }
 
     return root;
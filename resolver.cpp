@@ -0,0 +1,119 @@
+#include "resolver.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace {
+// The lambdas around an expression, innermost first. Each runs in a frame
+// of its own whose parent is the frame of the lambda around it.
+struct Frame {
+    const Frame* parent = nullptr;
+    // Parameter names in slot order, a repeated name has the first slot.
+    std::vector<SymbolId> params;
+    // Names of the defines in the body outside nested lambdas.
+    std::vector<SymbolId> defined;
+};
+
+bool Contains(const std::vector<SymbolId>& ids, SymbolId id) {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+// The name in a cell that holds a symbol, the way parameters and the
+// targets of define are held, or nullptr.
+Symbol* NameOf(Object* obj) {
+    auto cell = As<Cell>(obj);
+    return cell != nullptr ? As<Symbol>(cell->GetFirst()) : nullptr;
+}
+
+class Resolver {
+public:
+    Resolver() : define_(SymbolTable::GetTable().Intern("_define-var")) {
+    }
+
+    void Run(Object* root) {
+        // Chains are as long as the lists they hold, so they are walked
+        // with a stack instead of recursion.
+        pending_.emplace_back(root, nullptr);
+        while (!pending_.empty()) {
+            auto [obj, frame] = pending_.back();
+            pending_.pop_back();
+            Visit(obj, frame);
+        }
+
+        // A define may follow the names it adds, so the frames are only
+        // complete now.
+        for (auto [symbol, frame] : symbols_) {
+            symbol->SetAddress(Locate(symbol->GetId(), frame));
+        }
+    }
+
+private:
+    void Visit(Object* obj, Frame* frame) {
+        if (Is<Symbol>(obj)) {
+            symbols_.emplace_back(As<Symbol>(obj), frame);
+        } else if (Is<LambdaCell>(obj)) {
+            auto lambda = As<LambdaCell>(obj);
+            auto inner = EnterLambda(lambda, frame);
+            pending_.emplace_back(lambda->GetSecond(), inner);
+        } else if (Is<Cell>(obj)) {
+            auto cell = As<Cell>(obj);
+            auto head = NameOf(cell);
+            if (frame != nullptr && head != nullptr &&
+                head->GetId() == define_) {
+                if (auto name = NameOf(cell->GetSecond())) {
+                    frame->defined.push_back(name->GetId());
+                }
+            }
+            pending_.emplace_back(cell->GetSecond(), frame);
+            pending_.emplace_back(cell->GetFirst(), frame);
+        }
+    }
+
+    Frame* EnterLambda(LambdaCell* lambda, Frame* parent) {
+        auto& frame = frames_.emplace_back();
+        frame.parent = parent;
+
+        // The parameters are bound in order, see LambdaInvoker::Apply.
+        const auto& args = lambda->GetArguments();
+        int varc = As<LambdaSymbol>(lambda->GetFirst())->GetVarc();
+        size_t params = std::min<size_t>(varc, args.size());
+        for (size_t i = 0; i < params; ++i) {
+            auto name = NameOf(args[i]);
+            if (name != nullptr && !Contains(frame.params, name->GetId())) {
+                frame.params.push_back(name->GetId());
+            }
+        }
+        return &frame;
+    }
+
+    // A define of a name a frame further out already binds changes that
+    // binding, so only names that are not parameters anywhere around can be
+    // added to a frame.
+    static LexicalAddress Locate(SymbolId id, const Frame* frame) {
+        uint32_t depth = 0;
+        for (auto cur = frame; cur != nullptr; cur = cur->parent, ++depth) {
+            auto it = std::find(cur->params.begin(), cur->params.end(), id);
+            if (it != cur->params.end()) {
+                return {LexicalAddress::Kind::kLocal, depth,
+                        static_cast<uint32_t>(it - cur->params.begin())};
+            }
+        }
+        for (auto cur = frame; cur != nullptr; cur = cur->parent) {
+            if (Contains(cur->defined, id)) {
+                return {LexicalAddress::Kind::kDynamic};
+            }
+        }
+        return {LexicalAddress::Kind::kGlobal};
+    }
+
+private:
+    SymbolId define_;
+    std::deque<Frame> frames_;
+    std::vector<std::pair<Object*, Frame*>> pending_;
+    std::vector<std::pair<Symbol*, Frame*>> symbols_;
+};
+}  // namespace
+
+void Resolve(Object* root) {
+    Resolver().Run(root);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "object.h"
+
+// Gives every symbol in a parsed expression the place its value is looked up
+// at, see LexicalAddress. A parameter of a lambda around the symbol is found
+// by frame depth and slot. Any other name is global, unless a lambda around
+// it defines the name, which can add it to that lambda's frame at run time;
+// such names are still looked up frame by frame.
+void Resolve(Object* root);
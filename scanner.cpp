@@ -0,0 +1,176 @@
+#include "scanner.h"
+
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define LISP_SCANNER_X86
+#include <immintrin.h>
+#define LISP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+template <uint8_t kClass>
+size_t SkipScalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && HasClass(data[pos], kClass)) {
+        ++pos;
+    }
+    return pos;
+}
+
+#ifdef LISP_SCANNER_X86
+// Each class is a few byte ranges and single bytes, tested with unsigned
+// compares: ch is in [lo, hi] if min(ch - lo, hi - lo) == ch - lo.
+__m128i InRange(__m128i v, char lo, char hi) {
+    auto shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(hi - lo)),
+                          shifted);
+}
+
+__m128i Equals(__m128i v, char ch) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch));
+}
+
+__m128i BlankMask(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(Equals(v, ' '), Equals(v, '\t')),
+                        _mm_or_si128(Equals(v, '\n'), Equals(v, '\xff')));
+}
+
+__m128i DigitMask(__m128i v) {
+    return InRange(v, '0', '9');
+}
+
+__m128i SymbolMask(__m128i v) {
+    // Setting bit 5 maps upper case letters onto lower case ones.
+    auto letters = InRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    auto ranges = _mm_or_si128(
+        letters, _mm_or_si128(InRange(v, '0', '9'), InRange(v, '<', '?')));
+    auto singles = _mm_or_si128(
+        _mm_or_si128(Equals(v, '!'), Equals(v, '#')),
+        _mm_or_si128(_mm_or_si128(Equals(v, '*'), Equals(v, '-')),
+                     Equals(v, '/')));
+    return _mm_or_si128(ranges, singles);
+}
+
+template <__m128i (*Mask)(__m128i), uint8_t kClass>
+size_t SkipSse2(const char* data, size_t pos, size_t size) {
+    for (; pos + 16 <= size; pos += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t outside = ~_mm_movemask_epi8(Mask(v)) & 0xFFFF;
+        if (outside != 0) {
+            return pos + __builtin_ctz(outside);
+        }
+    }
+    return SkipScalar<kClass>(data, pos, size);
+}
+
+LISP_TARGET_AVX2 __m256i InRange(__m256i v, char lo, char hi) {
+    auto shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(
+        _mm256_min_epu8(shifted, _mm256_set1_epi8(hi - lo)), shifted);
+}
+
+LISP_TARGET_AVX2 __m256i Equals(__m256i v, char ch) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch));
+}
+
+LISP_TARGET_AVX2 __m256i BlankMask(__m256i v) {
+    return _mm256_or_si256(
+        _mm256_or_si256(Equals(v, ' '), Equals(v, '\t')),
+        _mm256_or_si256(Equals(v, '\n'), Equals(v, '\xff')));
+}
+
+LISP_TARGET_AVX2 __m256i DigitMask(__m256i v) {
+    return InRange(v, '0', '9');
+}
+
+LISP_TARGET_AVX2 __m256i SymbolMask(__m256i v) {
+    auto letters =
+        InRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    auto ranges = _mm256_or_si256(
+        letters, _mm256_or_si256(InRange(v, '0', '9'), InRange(v, '<', '?')));
+    auto singles = _mm256_or_si256(
+        _mm256_or_si256(Equals(v, '!'), Equals(v, '#')),
+        _mm256_or_si256(_mm256_or_si256(Equals(v, '*'), Equals(v, '-')),
+                        Equals(v, '/')));
+    return _mm256_or_si256(ranges, singles);
+}
+
+// The tail too short for AVX2 goes to SSE2 with the same class.
+template <__m256i (*Mask)(__m256i), __m128i (*Mask128)(__m128i),
+          uint8_t kClass>
+LISP_TARGET_AVX2 size_t SkipAvx2(const char* data, size_t pos, size_t size) {
+    for (; pos + 32 <= size; pos += 32) {
+        auto v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        auto outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(Mask(v)));
+        if (outside != 0) {
+            return pos + __builtin_ctz(outside);
+        }
+    }
+    return SkipSse2<Mask128, kClass>(data, pos, size);
+}
+#endif
+
+std::vector<RunScanners> FindRunScanners() {
+    std::vector<RunScanners> scanners;
+#ifdef LISP_SCANNER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        scanners.push_back({"avx2", SkipAvx2<BlankMask, BlankMask, kBlank>,
+                            SkipAvx2<DigitMask, DigitMask, kDigit>,
+                            SkipAvx2<SymbolMask, SymbolMask, kSymbol>});
+    }
+    scanners.push_back({"sse2", SkipSse2<BlankMask, kBlank>,
+                        SkipSse2<DigitMask, kDigit>,
+                        SkipSse2<SymbolMask, kSymbol>});
+#endif
+    scanners.push_back({"scalar", SkipScalar<kBlank>, SkipScalar<kDigit>,
+                        SkipScalar<kSymbol>});
+    return scanners;
+}
+
+const RunScanners& GetScanners() {
+    static const RunScanners kScanners = GetRunScanners().front();
+    return kScanners;
+}
+}  // namespace
+
+const std::vector<RunScanners>& GetRunScanners() {
+    static const std::vector<RunScanners> kRunScanners = FindRunScanners();
+    return kRunScanners;
+}
+
+size_t SkipBlanksVector(const char* data, size_t pos, size_t size) {
+    return GetScanners().blanks(data, pos, size);
+}
+
+size_t SkipDigitsVector(const char* data, size_t pos, size_t size) {
+    return GetScanners().digits(data, pos, size);
+}
+
+size_t SkipSymbolVector(const char* data, size_t pos, size_t size) {
+    return GetScanners().symbol(data, pos, size);
+}
+
+uint64_t ParseDigits(const char* data, size_t size) {
+    uint64_t value = 0;
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Pairs of digits are merged into bytes, then pairs of bytes and pairs
+    // of those, leaving the eight digit number in the upper half.
+    for (; i + 8 <= size; i += 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, data + i, 8);
+        chunk -= 0x3030303030303030;
+        chunk = chunk * 10 + (chunk >> 8);
+        chunk = ((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32)) +
+                 ((chunk >> 16) & 0x000000FF000000FF) *
+                     (1 + (10000ULL << 32))) >>
+                32;
+        value = value * 100000000 + chunk;
+    }
+#endif
+    for (; i < size; ++i) {
+        value = value * 10 + (data[i] - '0');
+    }
+    return value;
+}
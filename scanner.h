@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Character classes of the tokenizer. Blanks are ' ', '\t', '\n' and 0xFF,
+// which is EOF read as a char. Symbols start with a letter or one of <=>*/#
+// and go on with letters, digits and <=>*/#?!-.
+enum CharClass : uint8_t {
+    kBlank = 1,
+    kSymbolStart = 2,
+    kSymbol = 4,
+    kDigit = 8,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    classes[' '] = classes['\t'] = classes['\n'] = classes[0xFF] = kBlank;
+    for (int ch = 0; ch < 26; ++ch) {
+        classes['a' + ch] = kSymbolStart | kSymbol;
+        classes['A' + ch] = kSymbolStart | kSymbol;
+    }
+    for (int ch = '0'; ch <= '9'; ++ch) {
+        classes[ch] = kDigit | kSymbol;
+    }
+    for (unsigned char ch : {'<', '=', '>', '*', '/', '#'}) {
+        classes[ch] = kSymbolStart | kSymbol;
+    }
+    for (unsigned char ch : {'?', '!', '-'}) {
+        classes[ch] = kSymbol;
+    }
+    return classes;
+}
+
+inline constexpr std::array<uint8_t, 256> kCharClasses = MakeCharClasses();
+
+inline bool HasClass(char ch, uint8_t mask) {
+    return kCharClasses[static_cast<unsigned char>(ch)] & mask;
+}
+
+// Scan a run 32 or 16 bytes at a time with AVX2 or SSE2, whichever the CPU
+// has, and byte by byte elsewhere. Each returns the first position from pos
+// on whose byte is outside the class, or size.
+size_t SkipBlanksVector(const char* data, size_t pos, size_t size);
+size_t SkipDigitsVector(const char* data, size_t pos, size_t size);
+size_t SkipSymbolVector(const char* data, size_t pos, size_t size);
+
+// One implementation of the three scans above.
+struct RunScanners {
+    const char* name;
+    size_t (*blanks)(const char*, size_t, size_t);
+    size_t (*digits)(const char*, size_t, size_t);
+    size_t (*symbol)(const char*, size_t, size_t);
+};
+
+// The implementations this CPU can run, fastest first, ending with the byte
+// by byte one. The first is what the *Vector functions call.
+const std::vector<RunScanners>& GetRunScanners();
+
+// Most runs in source are a few bytes long, so the first bytes are looked at
+// one at a time before the vector scan is called.
+template <uint8_t kClass, size_t (*kVector)(const char*, size_t, size_t)>
+size_t SkipRun(const char* data, size_t pos, size_t size) {
+    constexpr size_t kShortRun = 4;
+    for (size_t end = pos + kShortRun; pos < size; ++pos) {
+        if (!HasClass(data[pos], kClass)) {
+            return pos;
+        } else if (pos == end) {
+            return kVector(data, pos, size);
+        }
+    }
+    return size;
+}
+
+inline size_t SkipBlanks(const char* data, size_t pos, size_t size) {
+    return SkipRun<kBlank, SkipBlanksVector>(data, pos, size);
+}
+
+inline size_t SkipDigits(const char* data, size_t pos, size_t size) {
+    return SkipRun<kDigit, SkipDigitsVector>(data, pos, size);
+}
+
+inline size_t SkipSymbol(const char* data, size_t pos, size_t size) {
+    return SkipRun<kSymbol, SkipSymbolVector>(data, pos, size);
+}
+
+// The value of size decimal digits modulo 2^64. Eight digits are combined
+// at a time.
+uint64_t ParseDigits(const char* data, size_t size);
@@ -0,0 +1,21 @@
+#include "symbol_table.h"
+
+SymbolTable& SymbolTable::GetTable() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolId SymbolTable::Intern(std::string_view name) {
+    if (auto it = ids_.find(name); it != ids_.end()) {
+        return it->second;
+    }
+
+    SymbolId id = names_.size();
+    names_.emplace_back(name);
+    ids_.emplace(names_.back(), id);
+    return id;
+}
+
+const std::string& SymbolTable::GetName(SymbolId id) const {
+    return names_[id];
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using SymbolId = uint32_t;
+
+// Interns symbol names, so each distinct name is stored once and symbols
+// compare and hash by id. Names are never released.
+class SymbolTable {
+public:
+    static SymbolTable& GetTable();
+
+public:
+    SymbolId Intern(std::string_view name);
+    const std::string& GetName(SymbolId id) const;
+
+private:
+    // A deque never moves its elements, so the views in ids_ stay valid.
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, SymbolId> ids_;
+};
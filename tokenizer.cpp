@@ -1,63 +1,11 @@
 #include "tokenizer.h"
 #include "error.h"
+#include "scanner.h"
 
 #include <cassert>
 
-namespace {
-
-std::string blank_symbols = {EOF, ' ', '\t', '\n'};
-std::string valid_start_symbols = "<=>*/#";
-std::string valid_symbols = "<=>*/#?!-";
-
-std::string mono_tokens = "().'";
-
-bool IsNumber(const std::string &s) {
-    if (s.empty()) {
-        return false;
-    }
-
-    size_t start = s[0] == '+' || s[0] == '-';
-
-    if (start && s.size() == 1) {
-        return false;
-    }
-
-    return s.find_first_not_of("0123456789", start) == std::string::npos;
-}
-
-bool ValidStartSymbol(char ch) {
-    return isalpha(ch) || valid_start_symbols.find(ch) != std::string::npos;
-}
-
-bool ValidSymbol(char ch) {
-    return isalnum(ch) || valid_symbols.find(ch) != std::string::npos;
-}
-
-bool CheckValidSymbol(const std::string &s) {
-    if (s.empty()) {
-        return false;
-    }
-
-    if (s == "+" || s == "-") {
-        return true;
-    }
-
-    if (!ValidStartSymbol(s[0])) {
-        return false;
-    }
-
-    for (size_t i = 1; i < s.size(); i++) {
-        if (!ValidSymbol(s[i])) {
-            return false;
-        }
-    }
-
-    return true;
-}
-}  // namespace
-
 bool SymbolToken::operator==(const SymbolToken &other) const {
-    return name == other.name;
+    return id == other.id;
 }
 
 bool QuoteToken::operator==(const QuoteToken &) const {
@@ -80,24 +28,16 @@ bool InvalidToken::operator==(const InvalidToken &) const {
     return true;
 }
 
-void ConstantToken::FromString(const std::string &str) {
+void ConstantToken::FromString(std::string_view str) {
     assert(!str.empty());
 
     size_t start = str[0] == '-' || str[0] == '+';
-    value = 0;
-
-    for (size_t i = start; i != str.size(); ++i) {
-        value = value * 10 + (str[i] - '0');
-    }
-
-    if (str[0] == '-') {
-        value *= -1;
-    }
+    uint64_t digits = ParseDigits(str.data() + start, str.size() - start);
+    value = static_cast<int64_t>(str[0] == '-' ? 0 - digits : digits);
 }
 
 std::vector<Token> Read(const std::string &string) {
-    std::istringstream in(string);
-    Tokenizer tokenizer(&in);
+    Tokenizer tokenizer(string);
 
     std::vector<Token> result;
     while (!tokenizer.IsEnd()) {
@@ -112,40 +52,59 @@ Tokenizer::Tokenizer(std::istream *in) : in_(in) {
     Next();
 }
 
+Tokenizer::Tokenizer(std::string_view input) : data_(input) {
+    Next();
+}
+
 bool Tokenizer::IsEnd() {
     return IsSameToken<InvalidToken>(&current_token_);
 }
 
 void Tokenizer::Next() {
     SkipEmpty();
-
-    std::string token = ReadToken();
-    if (token.empty()) {
+    start_ = pos_;
+    if (!HasChar()) {
         current_token_ = InvalidToken();
-    } else if (token == "'") {
-        current_token_ = QuoteToken();
-    } else if (token == ".") {
-        current_token_ = DotToken();
-    } else if (token == "(") {
+        return;
+    }
+
+    char start = data_[pos_++];
+    if (start == '(') {
         current_token_ = BracketToken::OPEN;
-    } else if (token == ")") {
+    } else if (start == ')') {
         current_token_ = BracketToken::CLOSE;
-    } else if (IsNumber(token)) {
-        ConstantToken temp;
-        temp.FromString(token);
-        current_token_ = temp;
-    } else if (token.size() == 2 && token[0] == '#' && (token[1] == 'f' || token[1] == 't')) {
+    } else if (start == '\'') {
+        current_token_ = QuoteToken();
+    } else if (start == '.') {
+        current_token_ = DotToken();
+    } else if (start == '+' || start == '-' || HasClass(start, kDigit)) {
+        Skip<SkipDigits>();
+
+        auto token = data_.substr(start_, pos_ - start_);
+        if (token.size() == 1 && !HasClass(start, kDigit)) {
+            current_token_ = SymbolToken{SymbolTable::GetTable().Intern(token)};
+        } else {
+            ConstantToken temp;
+            temp.FromString(token);
+            current_token_ = temp;
+        }
+    } else if (start == '#' && HasChar() &&
+               (data_[pos_] == 'f' || data_[pos_] == 't')) {
         BooleanToken temp;
-        temp.value = token == "#t";
+        temp.value = data_[pos_++] == 't';
         current_token_ = temp;
+    } else if (HasClass(start, kSymbolStart)) {
+        Skip<SkipSymbol>();
+
+        auto token = data_.substr(start_, pos_ - start_);
+        current_token_ = SymbolToken{SymbolTable::GetTable().Intern(token)};
     } else {
-        if (CheckValidSymbol(token)) {
-            SymbolToken temp;
-            temp.name = token;
-            current_token_ = temp;
-        } else {
-            throw SyntaxError("Invalid sequence: " + token);
+        while (HasChar() && !HasClass(data_[pos_], kBlank)) {
+            ++pos_;
         }
+
+        auto token = data_.substr(start_, pos_ - start_);
+        throw SyntaxError("Invalid sequence: " + std::string(token));
     }
 }
 
@@ -158,59 +117,36 @@ Token Tokenizer::GetToken() {
 }
 
 void Tokenizer::SkipEmpty() {
-    while (in_->peek() != EOF) {
-        char ch = in_->peek();
-        if (blank_symbols.find(ch) != std::string::npos) {
-            in_->get(ch);
-        } else {
-            break;
-        }
-    }
+    Skip<SkipBlanks>();
 }
 
-std::string Tokenizer::ReadToken() {
-    std::string token;
-
-    if (in_->peek() == EOF) {
-        return token;
-    }
-
-    char start;
-    in_->get(start);
-    token.push_back(start);
-
-    if (mono_tokens.find(start) != std::string::npos) {
-        return token;
-    }
-
-    if (start == '+' || start == '-' || isdigit(start)) {
-        while (isdigit(in_->peek())) {
-            token.push_back(' ');
-            in_->get(token.back());
+template <size_t (*kSkip)(const char*, size_t, size_t)>
+void Tokenizer::Skip() {
+    while (HasChar()) {
+        pos_ = kSkip(data_.data(), pos_, data_.size());
+        if (pos_ < data_.size()) {
+            return;
         }
-
-        return token;
-    }
-
-    if (start == '#' && (in_->peek() == 'f' || in_->peek() == 't')) {
-        token.push_back(' ');
-        in_->get(token.back());
-        return token;
     }
+}
 
-    if (ValidStartSymbol(start)) {
-        while (ValidSymbol(in_->peek())) {
-            token.push_back(' ');
-            in_->get(token.back());
-        }
+bool Tokenizer::HasChar() {
+    return pos_ < data_.size() || Refill();
+}
 
-        return token;
+bool Tokenizer::Refill() {
+    if (in_ == nullptr || !*in_) {
+        return false;
     }
 
-    while (blank_symbols.find(in_->peek()) == std::string::npos) {
-        token.push_back(' ');
-        in_->get(token.back());
-    }
+    buffer_.erase(0, start_);
+    pos_ -= start_;
+    start_ = 0;
 
-    return token;
+    size_t size = buffer_.size();
+    buffer_.resize(size + kChunkSize);
+    in_->read(buffer_.data() + size, kChunkSize);
+    buffer_.resize(size + in_->gcount());
+    data_ = buffer_;
+    return buffer_.size() > size;
 }
@@ -3,11 +3,15 @@
 #include <istream>
 #include <optional>
 #include <sstream>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+#include "symbol_table.h"
+
+// Names are interned as they are read, see SymbolTable.
 struct SymbolToken {
-        std::string name;
+        SymbolId id;
         bool operator==(const SymbolToken& other) const;
 };
 
@@ -25,7 +29,7 @@ struct ConstantToken {
         int64_t value;
 
         bool operator==(const ConstantToken& other) const;
-        void FromString(const std::string& str);
+        void FromString(std::string_view str);
 };
 
 struct BooleanToken {
@@ -42,19 +46,36 @@ using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken,
 
 std::vector<Token> Read(const std::string& string);
 
+// Scans a contiguous buffer. Input given as a view is scanned in place, a
+// stream is read into an owned buffer a chunk at a time.
 class Tokenizer {
+    public:
+        static constexpr size_t kChunkSize = 1 << 16;
+
     public:
         Tokenizer(std::istream* in);
+        Tokenizer(std::string_view input);
         bool IsEnd();
         void Next();
         Token GetToken();
 
     private:
         void SkipEmpty();
-        std::string ReadToken();
+        // Moves pos_ past the run kSkip finds, see scanner.h.
+        template <size_t (*kSkip)(const char*, size_t, size_t)>
+        void Skip();
+        // Whether there is a character at pos_, reading more of the stream
+        // if needed. Refilling drops what comes before start_.
+        bool HasChar();
+        bool Refill();
 
     private:
-        std::istream* in_;
+        std::istream* in_ = nullptr;
+        std::string buffer_;
+        std::string_view data_;
+        // Where the current token starts and where scanning is.
+        size_t start_ = 0;
+        size_t pos_ = 0;
         Token current_token_;
 };
 